@@ -51,7 +51,7 @@
 //P2.0=cadence capture
 //P2.2=torque capture
 //
-//you need ANT NETWORK_ID at ANTAP1_AssignNetwork()
+//you need ANT NETWORK_ID at ANT_NET_KEY0..7 in ant.h
 //visit this is transient com and make free acount!
 //goloveski
 //******************************************************************************
@@ -59,369 +59,101 @@
 
 //#include "msp430g2452.h"
 #include <stdint.h>
-#include "msp430g2553.h"
+#include "hal.h"
+#include "ant.h"
+#include "srm.h"
+#include "event.h"
+#include "cal.h"
+#include "prof.h"
+#include "energy.h"
+#include "stack.h"
+#include "log.h"
+#include "lpm.h"
 
 //------------------------------------------------------------------------------
 // Hardware-related definitions
 //------------------------------------------------------------------------------
-#define UART_TXD   0x02                     // TXD on P1.1 (Timer0_A.OUT0)
-#define UART_RXD   0x04                     // RXD on P1.2 (Timer0_A.CCI1A)
+#define UART_TXD   0x02                     // TXD on P1.1 (Timer0_A.OUT0 / UCA0TXD)
+#define UART_RXD   0x04                     // RXD on P1.2 (Timer0_A.CCI1A / UCA0RXD)
 
+#ifdef UART_USCI_A0
 //------------------------------------------------------------------------------
-// Conditions for 9600 Baud SW UART, SMCLK = 1MHz
+// Conditions for USCI_A0 UART at UART_BAUD (hal.h), SMCLK = 1MHz, no
+// oversampling: UCBRx = integer divider, UCBRSx = round(8 * fraction)
 //------------------------------------------------------------------------------
-//#define UART_TBIT_DIV_2     (1000000 / (9600 * 2))
-//#define UART_TBIT           (1000000 / 9600)
+#define UART_UCBR           (1000000UL / UART_BAUD)
+#define UART_UCBRS          ((8000000UL + UART_BAUD / 2) / UART_BAUD - 8 * UART_UCBR)
 
-#define UART_TBIT_DIV_2     (1000000 / (4800 * 2))
-#define UART_TBIT           (1000000 / 4800)
+#define UART_init()         USCI_A0_UART_init()
+#define UART_tx_drain()     while (UCA0STAT & UCBUSY)   // last stop bit
+#else
+//------------------------------------------------------------------------------
+// Conditions for 4800/9600 Baud SW UART, SMCLK = 1MHz
+//------------------------------------------------------------------------------
+#define UART_TBIT_DIV_2     (1000000 / (UART_BAUD * 2))
+#define UART_TBIT           (1000000 / UART_BAUD)
+
+#define UART_init()         TimerA_UART_init()
+#define UART_tx_drain()                         // ISR ends after the stop bit
+#endif
 
 //------------------------------------------------------------------------------
 // Global variables used for full-duplex UART communication
 //------------------------------------------------------------------------------
 unsigned int txData;                        // UART internal variable for TX
-unsigned char rxBuffer;                     // Received UART character
-const char string1[] = { "Hello World\r\n" };
-unsigned int i;
 
 //------------------------------------------------------------------------------
 // Function prototypes
 //------------------------------------------------------------------------------
 void TimerA_UART_init(void);
-void TimerA_UART_tx(unsigned char byte);
-
-void Timer1_A_period_CAL_init(void);
-void Timer1_A_period_init(void);
+void USCI_A0_UART_init(void);
+static void torque_wake_arm(void);
 
-#define msecConv(x) ((x)/32)
+#if ANT_CH_PER * LPM_IDLE_DIV + 7 > 0xFFFF
+#error "ANT_CH_PER * LPM_IDLE_DIV must fit the 16 bit slotFraction"
+#endif
+unsigned int slotFraction;                  // slot period remainder, 1/8 Timer1 ticks
+unsigned int timer1Wraps;                   // Timer1_A overflows, every 16 s
 
 //------------------------------------------------------------------------------
-// ANT Data
+// Clock manager: MCLK = 8MHz while the main loop has work, 1MHz otherwise,
+// so events are done sooner and the CPU is back in LPM3 sooner.  SMCLK is
+// the DCO divided down to 1MHz at both speeds, so the UART bit timing
+// (UART_TBIT, UART_UCBR) and the flash timing generator never change; only
+// the few cycles between the register writes run off.  Not 16MHz: that
+// needs Vcc >= 3.3V and the coin cell gives 3V.
 //------------------------------------------------------------------------------
-#define MESG_NETWORK_KEY_ID      0x46
-#define MESG_NETWORK_KEY_SIZE       9
-#define ANT_CH_ID    0x00
-#define ANT_CH_TYPE  0x10     //Master (0x10)
-#define ANT_NET_ID   0x00
-#define ANT_DEV_ID1  0x31     //49
-#define ANT_DEV_ID2  0x00
-#define ANT_DEV_TYPE 0x0B     // Device Type, HRM=0x78, Power=0x0B(11)
-#define ANT_TX_TYPE  0x05     //ANT+ devices follow the transmission type definition as outlined in the ANT protocol.
-#define ANT_CH_FREQ  0x0039   //   2457MHz
-#define ANT_CH_PER   0x1FF6   //0x1FF6 8182/32768=4.004888780Hz // 0x1FA6 8102/32768=4.044Hz  8192/32768=4Hz
-
-//Pedal Power define
-#define Power_data   0x012C   // 012C=300W
-
-//Standard Crank Torque data define
-#define crank_period   0x0580   // 0x555 : 2048 / 1365 * 60  90rpm  max 0x10000 <
-#define crank_torque   0x0420   // 1/32Nm 0x10000 <
-
-//Crank Torque Frequency data define
-#define ctf_time_stamp   0x0580   //
-#define ctf_torque_ticks 0x0420   //
-
-//#define kPeriod      0x2465 // 32768/37268*4=4Hz -> capture torque tickets
-//#define kPeriod      0x1FF6   //0x1FF6 8182/32768=4.004888780Hz
-//#define kPeriod      0xFFFF // 32768/37268*4=4Hz -> capture torque tickets
-#define kPeriod      0x04FD   //0x1FF6 8182/32768=4.004888780Hz
-
-typedef uint8_t uchar;
-uchar txBuffer[256];
-uint8_t txBufferSize;
-uint8_t txBufferPos;
-
-unsigned int new_timer=0;
-unsigned int old_timer=0;
-unsigned int timer_diff=0;
-unsigned int old_transmit_timer=0;            // Last transmit time
-
-unsigned int index=0;
-unsigned int count = 0;
-
-unsigned int PulseCount=0;
-unsigned int TorqueTicket=0;
-unsigned int TorqueTicket_carry=0;
-
-unsigned int chatter_count13 = 0;
-
-uint16_t ctf_time_stamp1;
-uint16_t ctf_torque_ticks1;
-uint16_t ctf_torque_ticks2;
-uint8_t Rotation_event_counter;
-
-enum{
-    CTMMODE = 1,
-    OFFSETMODE
-};
-
-//int unqomode = CTMMODE;         // for mode changer 1=CTM mode 2=OFFSET mode
-int unqomode = OFFSETMODE;         // for mode changer 1=CTM mode 2=OFFSET mode
-
-#define TORQUE_TICKET_MASK_TIME 2
-#define CADENCE_THRESHOLD_PULSE 13
-#define CHATTER_THRESHOLD 1
-
-
-//------------------------------------------------------------------------------
-//  TX: sync+data+sum+CR+LF
-//------------------------------------------------------------------------------
-
-void txMessage(uchar* message,uint8_t messageSize)
-{
-      uint8_t i;
-
-    _BIC_SR(GIE);  // disable interrupt
-
-    txBufferPos  = 0;                                      // set position to 0
-    txBufferSize = messageSize + 3;                        // message plus syc, size and checksum
-    txBuffer[0]  = 0xa4;                                   // sync byte
-    txBuffer[1]  = (uchar) messageSize - 1;                // message size - command size (1)
-
-    for(i=0; i<messageSize; i++)
-        txBuffer[2+i] = message[i];
-
-     // calculate the checksum
-    txBuffer[txBufferSize - 1] = 0;                        //add
-
-    for(i=0; i<txBufferSize - 1; ++i)
-        txBuffer[txBufferSize - 1] = txBuffer[txBufferSize - 1] ^ txBuffer[i];
-
-    _BIS_SR(GIE);                                          // enable interrupt
-
-    // now send via UART
-    for(i=0; i<txBufferSize; i++)
-        TimerA_UART_tx(txBuffer[i]);
-}
-
-//------------------------------------------------------------------------------
-//  ANT Data
-//------------------------------------------------------------------------------
-
-// Resets module
-void reset()
-{
-    uchar setup[2];
-
-    setup[0] = 0x4a;                           // ID Byte
-    setup[1] = 0x00;                           // Data Byte N (N=LENGTH)
-    txMessage(setup, sizeof(setup));
-}
-
-
-void ANTAP1_AssignNetwork()
-{
-    uchar setup[10];
-
-    setup[0] = MESG_NETWORK_KEY_ID;
-    setup[1] = ANT_CH_ID;                      // chan
-    setup[2] = 0x00;                           //NETWORK_KEY_ID
-    setup[3] = 0x00;
-    setup[4] = 0x00;
-    setup[5] = 0x00;
-    setup[6] = 0x00;
-    setup[7] = 0x00;
-    setup[8] = 0x00;
-    setup[9] = 0x00;
-    txMessage(setup, sizeof(setup));
-}
-
-
-// Assigns CH=0, CH Type=10(TX), Net#=0
-void assignch()
-{
-    uchar setup[4];
-
-    setup[0] = 0x42;
-    setup[1] = ANT_CH_ID;                      // Channel ID
-    setup[2] = ANT_CH_TYPE;                    // CH Type
-    setup[3] = ANT_NET_ID;                     // Network ID
-    txMessage(setup, sizeof(setup));
-}
-
-// set RF frequency
-void setrf()
-{
-    uchar setup[3];
-
-    setup[0] = 0x45;
-    //setup[1] = (ANT_CH_FREQ & 0xFF00) >> 8;
-    //setup[2] = (ANT_CH_FREQ & 0xFF);         // RF Frequency
-    setup[1] = ANT_CH_ID;                      // Channel ID
-    setup[2] = 0x39;                           // RF Frequency
-    txMessage(setup, sizeof(setup));
-}
-
-// set channel period
-void setchperiod()
-{
-    uchar setup[4];
-
-    setup[0] = 0x43;
-    setup[1] = ANT_CH_ID;
-    setup[2] = (ANT_CH_PER & 0xFF);            // Channel Period LSB
-    setup[3] = ((ANT_CH_PER & 0xFF00) >> 8);   // Channel Period MSB
-    txMessage(setup, sizeof(setup));
-}
-
-// Assigns CH#, Device#=0000, Device Type ID=00, Trans Type=00
-void setchid()
-{
-    uchar setup[6];
-
-    setup[0] = 0x51;
-    setup[1] = ANT_CH_ID;                      // Channel Number, 0x00 for HRM
-    setup[2] = ANT_DEV_ID1;                    // Device Number LSB
-    setup[3] = ANT_DEV_ID2;                    // Device Number MSB
-    setup[4] = ANT_DEV_TYPE;                   // Device Type, 0x78 for HRM
-    setup[5] = ANT_TX_TYPE;
-    txMessage(setup, sizeof(setup));
-}
-
-
-void setInfoData()
-{
-    uchar setup[7];
-
-    setup[0] = 0x51;
-    setup[1] = 0xFF;                    // Channel Number, 0x00 for HRM
-    setup[2] = 0xFF;                    // Device Number LSB
-    setup[3] = 1234;                    // Device Number MSB
-    setup[4] = ANT_DEV_TYPE;            // Device Type, 0x78 for HRM
-    setup[5] = ANT_TX_TYPE;
-    setup[6] = 12;
-    setup[7] = 34;
-    txMessage(setup, sizeof(setup));
-}
+static unsigned char clockFast;
 
-/////////////////////////////////////////////////////////////////////////
-// Priority:
-//
-// ucPower_:   0 = TX Power -20dBM
-//             1 = TX Power -10dBM
-//             2 = TX Power -5dBM
-//             3 = TX Power 0dBM
-//
-/////////////////////////////////////////////////////////////////////////
-/*
-void ChannelPower()
-{
-        uchar setup[3];
-        setup[0] = 0x47;
-        setup[1] = 0x00;
-        setup[2] = 0x03;
-
-
-        txMessage(setup, 3);
-}
-*/
-
-// Opens CH 0
-void opench()
-{
-    uchar setup[2];
-
-    setup[0] = 0x4b;
-    setup[1] = ANT_CH_ID;
-    txMessage(setup, sizeof(setup));
-}
-
-
-// Sends sendPower_n
-void sendPower_n(uchar num)
+static void clock_fast(void)
 {
-    uchar setup[10];
-
-    setup[0] = 0x4e;                                    //broadcast data
-    setup[1] = ANT_CH_ID;                               //
-    setup[2] = 0x10;                                    // 0x10 Data Page Number
-    setup[3] = num;                                     //Event Count max256
-    setup[4] = 0xB8;                                    //Pedal Power 0xFF > pedal power not used
-    setup[5] = 0x5F;                                    //Instantaneous Cadence 0x5A=90
-    setup[6] =  (0xFF & (Power_data * num ));           //Accumulated Power LSB
-    setup[7] = ((0xFF00 & (Power_data * num)) >>8);     //Accumulated Power MSB
-    setup[8] = (0xFF & Power_data);                     //Instantaneous Power LSB
-    setup[9] = ((0xFF00 & Power_data) >>8);             //Instantaneous Power MSB
-    txMessage(setup, sizeof(setup));
-}
-
-// Sends sendPower_SCT
-void sendPower_SCT(uchar num)
-{
-    uchar setup[10];
-
-    setup[0] = 0x4e;                                    //broadcast data
-    setup[1] = ANT_CH_ID;                               //0x41
-    setup[2] = 0x12;                                    //0x12 Data Page Number Standard Crank Torque
-    setup[3] = num;                                     //Event Count max 256
-    setup[4] = num;                                     //Crank Revolutions
-    setup[5] = 0xFF;                                    //Crank cadence  if available 0x5A=90 Otherwise: 0xFF
-    setup[6] =  (0xFF & (crank_period * num ));         //Accumulated crank period LSB
-    setup[7] = ((0xFF00 & (crank_period * num)) >>8);   //Accumulated crank period MSB
-    setup[8] = (0xFF & crank_torque* num);              //Accumulated torque LSB
-    setup[9] = ((0xFF00 & crank_torque* num) >>8);      //Accumulated torque MSB
-    txMessage(setup, sizeof(setup));
-}
-
-
-// Sends sendPower_CTF1
-void sendPower_CTF1()
-{
-    uchar setup[10];
-
-    setup[0] = 0x4e;                                    //broadcast data
-    setup[1] = ANT_CH_ID;                               //0x41
-    setup[2] = 0x20;                                    //0x20 Data Page Number Crank Torque Frequency
-    setup[3] = Rotation_event_counter;                  //Rotation event counter increments with each completed pedal revolution.
-    setup[4] = 0x01;                                    //Slope MSB 1/10 Nm/Hz
-    setup[5] = 0xF4;                                    //Slope LSB 1/10 Nm/Hz
-    setup[6] = ((0xFF00 & (ctf_time_stamp1)) >>8);      //Accumulated Time Stamp MSB 1/2000s
-    setup[7] =  (0x00FF & (ctf_time_stamp1));           //Accumulated Time Stamp LSB 1/2000s
-    setup[8] = ((0xFF00 & ctf_torque_ticks1) >>8);      //Accumulated Torque Ticks Stamp MSB
-    setup[9] =  (0x00FF & ctf_torque_ticks1);           //Accumulated Torque Ticks Stamp LSB
-    txMessage(setup, sizeof(setup));
-
-    if(Rotation_event_counter >= 0xFF)
-        Rotation_event_counter = 0x00;
-
+    if (clockFast)
+        return;
+    BCSCTL2 = DIVS_3;                       // SMCLK = DCO/8 from here on
+    DCOCTL = 0x00;                          // lowest DCOx while RSELx moves
+    BCSCTL1 = CALBC1_8MHZ | DIVA_3;         // keep ACLK/8 for Timer1_A
+    DCOCTL = CALDCO_8MHZ;
+    clockFast = 1;
 }
 
-// Sends sendPower_CTF1_Calibration
-void sendPower_CTF1_CAL()
+static void clock_slow(void)
 {
-    uchar setup[10];
-
-    setup[0] = 0x4e;                                    //broadcast data
-    setup[1] = ANT_CH_ID;                               //0x41;     //
-    setup[2] = 0x01;                                    //Data page Number : Calibration massage
-    setup[3] = 0x10;                                    //Calibration ID : CTF defined massage
-    setup[4] = 0x01;                                    //CTF Defined ID : Zero offset
-    setup[5] = 0xFF;                                    //Reserved :
-    setup[6] = 0xFF;                                    //Reserved :
-    setup[7] = 0xFF;                                    //Reserved :
-    setup[8] = ((0xFF00 & ctf_torque_ticks2) >>8);      //Offset MSB
-    setup[9] = ( 0x00FF & ctf_torque_ticks2);           //Offset LSB
-    txMessage(setup, sizeof(setup));
-}
-
-
-int calc_time_diff(int end_t,int start_t)
-{
-	/*TAIFGtOgĂ񂾂ǁc*/
-
-    if(end_t >= start_t)
-        return((unsigned int)(end_t - start_t));
-    else	/* if timer return to 0 */
-        return((unsigned int)((0xffff - start_t) + 1 + end_t));
+    if (!clockFast)
+        return;
+    DCOCTL = 0x00;
+    BCSCTL1 = CALBC1_1MHZ | DIVA_3;
+    DCOCTL = CALDCO_1MHZ;
+    BCSCTL2 = DIVS_0;                       // SMCLK = DCO again
+    clockFast = 0;
 }
 
-
 //------------------------------------------------------------------------------
 // main()
 //------------------------------------------------------------------------------
 void main(void)
 {
     WDTCTL = WDTPW + WDTHOLD;               // Stop watchdog timer
+    stack_paint();                          // before any interrupt can push
 
     DCOCTL = 0x00;                          // Set DCOCLK to 1MHz
     BCSCTL1 = CALBC1_1MHZ;
@@ -436,6 +168,9 @@ void main(void)
     P1DIR = 0xFF;
 
     P1SEL = UART_TXD + UART_RXD;            // Timer function for TXD/RXD pins
+#ifdef UART_USCI_A0
+    P1SEL2 = UART_TXD + UART_RXD;           // USCI_A0 function instead
+#endif
     P1DIR = 0xFF & ~UART_RXD;               // Set all pins but RXD to output
 
 // P1.6 LED setup
@@ -444,76 +179,47 @@ void main(void)
 // 1.0 LED setup
     P1DIR |=  BIT0;
 
+    cal_load();                             // zero offset and slope from info flash
+    log_init();                             // ride log: newest segment, blank ones
+
     __enable_interrupt();
-    TimerA_UART_init();                     // Start Timer_A UART
+    UART_init();                            // Start the ANT link UART
+
+// P1.3 held down at power-up: send the ride log before the AP1 is set up
+// (log.h), P1.0 on until the end block is out
+    P1DIR &= ~BIT3;                         // input, P1OUT.3 set: pull up
+    P1REN |= BIT3;
+    hal_delay_100us();
+    if (!(P1IN & BIT3))
+    {
+        P1OUT |= BIT0;
+        log_download_start();
+        while (logDownload)
+            ;
+        UART_tx_wait();                     // last block's CRC on the line
+        P1OUT &= ~BIT0;
+    }
 
-// ANT chip configuration
+// ANT chip configuration: each command goes out as soon as the module
+// acknowledged the one before (antBoot() in ant.c)
     P1OUT |= BIT0;                         //LED ON P1.0
 
-    reset();
-    P1OUT |= BIT0;
-    __delay_cycles(5000);                  // Delay between comm cycles
-    P1OUT &= ~BIT0;
-    //__delay_cycles(5000);
-
-    ANTAP1_AssignNetwork();
-    P1OUT |= BIT0;
-    __delay_cycles(5000);                  // Delay between comm cycles
-    P1OUT &= ~BIT0;
-    //__delay_cycles(5000);
-
-    assignch();
-    P1OUT |= BIT0;
-    __delay_cycles(5000);                  // Delay between comm cycles
-    P1OUT &= ~BIT0;
-    //__delay_cycles(5000);
-
-    setrf();
-    P1OUT |= BIT0;
-    __delay_cycles(5000);                  // Delay between comm cycles
-    P1OUT &= ~BIT0;
-    //__delay_cycles(5000);
-
-    setchperiod();
-    P1OUT |= BIT0;
-    __delay_cycles(5000);                  // Delay between comm cycles
-    P1OUT &= ~BIT0;
-    //__delay_cycles(5000);
-
-//  setInfoData();
-    setchid();
-    P1OUT |= BIT0;
-    __delay_cycles(5000);                  // Delay between comm cycles
-    P1OUT &= ~BIT0;
-    //__delay_cycles(5000);
-
-//    ChannelPower();
-//    P1OUT |= BIT0;
-//     __delay_cycles(5000);               // Delay between comm cycles
-//     P1OUT &= ~BIT0;
-//     __delay_cycles(5000);
-
-    opench();
-    P1OUT |= BIT0;
-    __delay_cycles(5000);         // Delay between comm cycles
-    P1OUT &= ~BIT0;
-    //__delay_cycles(5000);
-
-    __delay_cycles(250000);       // Delay between comm cycles
+    while (antBoot() != ANT_BOOT_FRAMES)   // refused or no answer after retries:
+        P1OUT ^= BIT0;                     // blink P1.0 and start over from reset
+
     P1OUT &= ~BIT0;               //LED OFF P1.0
-//    __delay_cycles(250000);     // Delay between comm cycles
 
     P1DIR &= ~BIT3;               // config P1-3 port set to input
     P1OUT |= BIT3;                // set to Output
     P1IES |= BIT3;                // interrupt edge to H -> L edge
 
 
-// 2.2 pin for pulse ticket capture
+// 2.2 pin for pulse ticket capture: Timer1_A3.CCI1B latches the edge time
     P1OUT |=  BIT0;               //LED ON P1.0
     P2DIR &= ~BIT2;               // INPUT mode
     P2REN |= BIT2;                // pull up enable
     P2OUT |= BIT2;                // pull VDD
-    P2IES |= BIT2;                // H -> L edge
+    P2SEL |= BIT2;                // P2.2 set to Timer1_A3.CCI1B, H -> L edge in TA1CCTL1
 
 //    __delay_cycles(250000);     // Delay between comm cycles
     P1OUT &= ~BIT0;               //LED OFF P1.0
@@ -525,30 +231,109 @@ void main(void)
     P2DIR &= ~BIT0;               // P2.0 set to TimerA_A3.CCI0A
     P2SEL |= BIT0;                // P2.0 Select ACLK function for pin
 
-    __delay_cycles(500000);       // Delay between comm cycles
-
     Timer1_A_period_init();
+    lpm_claim(LPM_CAPTURE | LPM_SLOT);      // Timer1_A runs from here on
+#if defined(ANT_CAD_CHANNEL) && !defined(UART_USCI_A0)
+    lpm_claim(LPM_UART_RX);                 // cadence pages answer EVENT_TX, and
+#endif                                      // the Timer_A RX needs SMCLK to catch it
 
     // interrupt enable
     //P1.3
     P1IE  |= BIT3;                // enable interrupt
     P1REN |= BIT3;                // interrupt Resistor Enable
 
-    //P2.2 
-    P2IE  |= BIT2;                // enable interrupt
+    //P2.2 capture interrupt is enabled by Timer1_A_period_init()
 
     P1OUT &= ~BIT0;               //LED OFF P1.0
 
+    // All work the vectors post runs here.  Check and sleep with interrupts
+    // off so an event posted between the two still wakes us up.
+    // The sleep is the deepest the claimed clocks allow (lpm.h): LPM0 while
+    // a frame is going out on the SMCLK UART, LPM3 while Timer1_A is in use,
+    // LPM4 when the SRM has gone quiet.
+    // Work runs at 8MHz, sleep at 1MHz (the DCO keeps running in LPM0).
+    // Every sleep and wake is timed for energy.c.
+    energy_start();
     for (;;)
     {
-        __low_power_mode_3();
+        uint8_t ev;
+        uint8_t mode;
+
+        __disable_interrupt();
+        ev = eventFlags;
+        eventFlags = 0;
+        if (ev)
+        {
+            __enable_interrupt();
+            clock_fast();
+            event_dispatch(ev);
+        }
+        else if ((mode = lpm_mode()) == LPM_SLEEP0)
+        {
+            clock_slow();
+            energy_sleep();
+            __bis_SR_register(LPM0_bits + GIE);
+            energy_wake(ENERGY_LPM0);
+        }
+        else if (mode == LPM_SLEEP3)
+        {
+            UART_tx_drain();
+            clock_slow();
+            energy_sleep();
+            __bis_SR_register(LPM3_bits + GIE);
+            energy_wake(ENERGY_LPM3);
+        }
+        else
+        {
+            UART_tx_drain();
+            clock_slow();
+            energy_sleep();
+            torque_wake_arm();
+            __bis_SR_register(LPM4_bits + GIE);
+            __bic_SR_register(OSCOFF);      // a vector that woke us left it set
+            energy_wake(ENERGY_LPM3);       // Timer1_A stood still: ~0 ticks
+        }
     }
 
 }
 
 //------------------------------------------------------------------------------
-// PORT1 mode change capture P1.3
+// LPM4 wake on the torque line: Timer1_A stops with ACLK, so P2.2 leaves its
+// capture function for a port interrupt until the first edge.  The 32 kHz
+// crystal takes a few hundred ms to start again, well inside the first
+// revolution.
+//------------------------------------------------------------------------------
+static void torque_wake_arm(void)
+{
+    P2SEL &= ~BIT2;                         // plain input, port interrupt works
+    P2IES |= BIT2;                          // H -> L, as the capture
+    P2IFG &= ~BIT2;                         // P2IES write may have set it
+    P2IE |= BIT2;
+}
+
+#pragma vector=PORT2_VECTOR
+__interrupt void Port_2(void)
+{
+    P2IE &= ~BIT2;
+    P2IFG &= ~BIT2;
+    P2SEL |= BIT2;                          // back to Timer1_A3.CCI1B
+    lpm_claim(LPM_CAPTURE);
+    energy_source(ENERGY_SRC_PORT2);
+    __bic_SR_register_on_exit(LPM4_bits);   // main loop, clocks on again
+}
+
+//------------------------------------------------------------------------------
+// PORT1 mode change capture P1.3, debounced by the watchdog interval timer
+//
+// The edge only disarms itself and starts the WDT on ACLK/64 (15.6 ms with
+// ACLK/8).  The press counts once P1.3 has read low MODE_DEBOUNCE_TICKS
+// times in a row, and the edge is armed again once it has read high as
+// often, so bounce on either side of the press is never seen.
 //------------------------------------------------------------------------------
+#define MODE_DEBOUNCE_TICKS 3                            // ~47 ms
+
+static unsigned char modeStable;                         // reads in a row
+static unsigned char modePressed;                        // press posted, wait for release
 
 #pragma vector=PORT1_VECTOR
 __interrupt void Port_1(void)
@@ -557,66 +342,82 @@ __interrupt void Port_1(void)
         return;                                          // not BIT3 when return
 
     P1IFG &= ~BIT3;   // clear flag
-
-    /*need chattering timer?*/
-    if(unqomode == OFFSETMODE)
-    {
-        P1OUT &= ~BIT0;                                  // LED_OFF
-        Timer1_A_period_init();
-        unqomode = CTMMODE;
-    }
-    else
-    {
-        P1OUT ^= BIT0;                                   // LED_ON
-        Timer1_A_period_CAL_init();
-        unqomode = OFFSETMODE;
-    }
+    P1IE &= ~BIT3;                                       // bounce is the WDT's business now
+
+    modeStable = 0;
+    modePressed = 0;
+    WDTCTL = WDT_ADLY_1_9;                               // ACLK/64 interval, no reset
+    IE1 |= WDTIE;
+    lpm_claim(LPM_DEBOUNCE);
+    __bic_SR_register_on_exit(OSCOFF);                   // from LPM4: ACLK for the WDT
 }
 
-
-#pragma vector=PORT2_VECTOR
-__interrupt void Port_2(void)
+static void mode_debounce_done(void)
 {
-    if(0 == (P2IFG & BIT2))                              // interrupt flag check
-        return;                                          // not BIT2 when return
-
-    P2IFG &= ~BIT2;                                      // clear flag
-
-    new_timer = TA1CCR0;                                 // TIMER_A0->TIMER1_A0, TACCR0->TA1CCR0
-
-    timer_diff = calc_time_diff(new_timer,old_timer);
-    old_timer = new_timer;
+    WDTCTL = WDTPW + WDTHOLD;
+    IE1 &= ~WDTIE;
+    lpm_release(LPM_DEBOUNCE);
+    P1IFG &= ~BIT3;                                      // edges while it bounced
+    P1IE |= BIT3;
+}
 
-    if(timer_diff > msecConv(TORQUE_TICKET_MASK_TIME))   //gap larger than "TORQUE_TICKET_MASK_TIME"msec
-    {
-        /*ׂpXō\ĂgN`Pbg̐擪JEg*/
-        TorqueTicket++;
-        PulseCount = 1;                                  //Counter Clear
-    }
-    else
+#pragma vector=WDT_VECTOR
+__interrupt void WDT_ISR(void)
+{
+    if(!modePressed)
     {
-        if(PulseCount >= 0xFFFE)
-            PulseCount = 0xFFFF;                         //Overflow
-        else
-            PulseCount++;                                //Counter
+        if(P1IN & BIT3)                                  // back high: bounce or spike
+            mode_debounce_done();
+        else if(++modeStable >= MODE_DEBOUNCE_TICKS)
+        {
+            modePressed = 1;
+            modeStable = 0;
+            event_post(EV_MODE);
+            energy_source(ENERGY_SRC_PORT1);
+            __bic_SR_register_on_exit(LPM3_bits);        // main loop switches mode
+        }
     }
+    else if(!(P1IN & BIT3))                              // still held
+        modeStable = 0;
+    else if(++modeStable >= MODE_DEBOUNCE_TICKS)         // released for good
+        mode_debounce_done();
+}
 
-    if(PulseCount >= CADENCE_THRESHOLD_PULSE)
-    {
-        /*ׂpXCADENCE_THRESHOLD_PULSE{ȏ゠΁APCfX*/
-        P1OUT ^= BIT6;                                   // LED_ON
-
-        Rotation_event_counter++;
-
-        ctf_torque_ticks1 = TorqueTicket;
-        TorqueTicket = 0;                                // added for reset
-
-        ctf_time_stamp1 = (uint16_t)((calc_time_diff(new_timer,old_transmit_timer)) / 2);
-
-        old_transmit_timer = new_timer;
 
-        sendPower_CTF1();
+//------------------------------------------------------------------------------
+// Timer1_A CCR1 capture: torque edge on P2.2, time latched by hardware
+//------------------------------------------------------------------------------
+#pragma vector=TIMER1_A1_VECTOR
+__interrupt void TIMER1_A1(void)
+{
+    PROF_ENTER(PROF_TIMER1_A1);
+
+    switch (__even_in_range(TA1IV, TA1IV_TAIFG)) {
+        case TA1IV_TACCR1:                               // TA1CCR1 CCIFG - torque edge
+            PROF_LATENCY(PROF_TIMER1_A1, TA1R - TA1CCR1);
+            if (TA1CCTL1 & COV) {                        // edge lost before we read CCR1
+                TA1CCTL1 &= ~COV;
+                captureMissed++;
+            }
+            capture_push(TA1CCR1);
+            event_post(EV_CAPTURE);
+            energy_source(ENERGY_SRC_PORT2);
+            __bic_SR_register_on_exit(LPM3_bits);        // main loop decodes it
+            break;
+        case TA1IV_TACCR2:                               // TA1CCR2 CCIFG - ANT channel slot
+            PROF_LATENCY(PROF_TIMER1_A1, TA1R - TA1CCR2);
+            slotFraction += (uint16_t)ANT_CH_PER * lpmSlotDiv;  // 32768Hz units, Timer1 is ACLK/8
+            TA1CCR2 += slotFraction >> 3;
+            slotFraction &= 7;
+            event_post(EV_SLOT);
+            energy_source(ENERGY_SRC_TIMER1);
+            __bic_SR_register_on_exit(LPM3_bits);        // main loop sends the page
+            break;
+        case TA1IV_TAIFG:                                // Timer1_A wrapped, upper 16 bits
+            timer1Wraps++;                               // of hal_timer1_now32()
+            break;
     }
+    PROF_EXIT(PROF_TIMER1_A1);
 }
 
 
@@ -626,73 +427,185 @@ __interrupt void Port_2(void)
 #pragma vector=TIMER1_A0_VECTOR
 __interrupt void TIMER1_A0(void)
 {
-    if(0 == (TACTL & TAIFG))                              // interrupt flag check
-        return;
+    PROF_ENTER(PROF_TIMER1_A0);
 
-    TACTL &= ~TAIFG;
+    PROF_LATENCY(PROF_TIMER1_A0, TA1R - TA1CCR0);
+    TA1CCR0 += kPeriod + 1;                               // next tick, timer keeps free running
 
-    if(unqomode == OFFSETMODE)
-    {
-      if(chatter_count13 == 0)
-      {
-          chatter_count13 = 1;
-          P1OUT ^= BIT6;                                   // LED_ON
-      }
-      else
-      {
-          chatter_count13 = 0;
-          P1OUT &= ~BIT6;                                   // LED_OFF
-      }
-
-      ctf_torque_ticks2 = TorqueTicket;
-      sendPower_CTF1_CAL();
-
-//        /*for test*/
-//        Rotation_event_counter++;
-//
-//        ctf_torque_ticks1 = 1234;
-//        ctf_time_stamp1 = (uint16_t)(500 / 2);
-//
-//        sendPower_CTF1();
+    event_post(EV_CAL_TICK);                              // CCIFG is the tick, Timer_A plays no part
+    energy_source(ENERGY_SRC_TIMER1);
+    __bic_SR_register_on_exit(LPM3_bits);                 // main loop sends the CAL page
+    PROF_EXIT(PROF_TIMER1_A0);
+}
 
-    }
+
+//------------------------------------------------------------------------------
+// The main loop has just parsed an EVENT_TX on the power channel (ant.c):
+// the pending slot moves to ANT_SYNC_TICKS from now, or a slot period later
+// if it is more than half of one off, so the slot of a period that already
+// had its page does not come twice
+//------------------------------------------------------------------------------
+void Timer1_A_slot_sync(void)
+{
+    hal_istate_t state = hal_irq_save();
+    unsigned int period = ((uint16_t)ANT_CH_PER * lpmSlotDiv) >> 3;
+    unsigned int at = TA1R + ANT_SYNC_TICKS;
+
+    if ((int)(TA1CCR2 - at) > (int)(period >> 1))
+        at += period;
+    TA1CCR2 = at;
+    slotFraction = 0;
+    hal_irq_restore(state);
 }
 
 
 //------------------------------------------------------------------------------
-// Function configures Timer1_A for CTM period capture
+// Next channel slot one slot period from now, at the current rate
+// (lpmSlotDiv), the remainder carried as in TIMER1_A1.  Interrupts off.
+//------------------------------------------------------------------------------
+static void Timer1_A_slot_arm(void)
+{
+    slotFraction += (uint16_t)ANT_CH_PER * lpmSlotDiv;  // 32768Hz units, Timer1 is ACLK/8
+    TA1CCR2 = TA1R + (slotFraction >> 3);
+    slotFraction &= 7;
+    TA1CCTL2 = CCIE;
+}
+
+//------------------------------------------------------------------------------
+// Function configures Timer1_A for CTM period capture.  Also a mode switch
+// from the main loop, with Timer1_A running: TA1CTL is only ever ORed, so
+// a pending TAIFG stays set and the wrap still gets counted.
 //------------------------------------------------------------------------------
 void Timer1_A_period_init(void)
 {
+    hal_istate_t state = hal_irq_save();
+
 //    TA1CCTL0 = CM_1 + SCS + CCIS_0 + CAP + CCIE;  // Rising edge + Timer1_A3.CCI0A (P2.0)
 //                                                  // + Capture Mode + Interrupt
     TA1CCTL0 = 0;
-    TA1CCTL1 = 0;
-    TA1CCTL2 = 0;
-    TA1CTL = TASSEL_1 + MC_2;                       // ACLK, Continus up mode
+    TA1CCTL1 = CM_2 + SCS + CCIS_1 + CAP + CCIE;    // Falling edge + Timer1_A3.CCI1B (P2.2)
+                                                    // + Capture Mode + Interrupt
+    Timer1_A_slot_arm();                            // ANT channel period broadcast slot
+    TA1CTL |= TASSEL_1 + MC_2 + TAIE;               // ACLK, Continus up mode, count wraps
+    hal_irq_restore(state);
 }
 
 
  //------------------------------------------------------------------------------
- // Function configures Timer1_A for cal period capture
+ // Function configures Timer1_A for cal period capture, TAIFG kept as above
  //------------------------------------------------------------------------------
 void Timer1_A_period_CAL_init(void)
 {
+    hal_istate_t state = hal_irq_save();
+
 //    TA1CCTL0 = CM_1 + SCS + CCIS_0 + CAP + CCIE;  // Rising edge + Timer1_A3.CCI0A (P2.0)
                                                     // + Capture Mode + Interrupt
 
-    TA1CCR0 = kPeriod;                              // set interrupt cycle
-    TA1CCTL0 = CCIE + OUTMOD_3;                     // enable interrupt + PWM toggle/reset
-    TA1CCTL1 = 0;
-    TA1CCTL2 = 0;
+    // Stays in continuous mode so the CCR1 capture time stamps keep wrapping
+    // at 0x10000; CCR0 is moved on by kPeriod+1 in TIMER1_A0 instead of up mode.
+    TA1CCR0 = TA1R + kPeriod + 1;                   // set interrupt cycle
+    TA1CCTL0 = CCIE;                                // enable interrupt
+    TA1CCTL1 = CM_2 + SCS + CCIS_1 + CAP + CCIE;    // Falling edge + Timer1_A3.CCI1B (P2.2)
+    Timer1_A_slot_arm();                            // ANT channel period broadcast slot
 
-    TA1CTL = TASSEL_1 + MC_1;                       // ACLK, UP to CCR0
+    TA1CTL |= TASSEL_1 + MC_2 + TAIE;               // ACLK, Continus up mode, count wraps
+    hal_irq_restore(state);
 
 //  TA1CCTL0 = SCS + CCIS_0 + CAP + CCIE;  //Timer1_A3.CCI0A (P2.0)
                                                     // + Capture Mode + Interrupt
 
 }
 
+//------------------------------------------------------------------------------
+// Timer1_A count extended to 32 bits (4096 Hz, wraps after 12 days).  A wrap
+// the vector has not counted yet shows as TAIFG set with a small count.
+//------------------------------------------------------------------------------
+uint32_t hal_timer1_now32(void)
+{
+    hal_istate_t state = hal_irq_save();
+    uint16_t lo = hal_timer1_now();
+    uint16_t hi = timer1Wraps;
+
+    if ((TA1CTL & TAIFG) && lo < 0x8000)
+        hi++;
+    hal_irq_restore(state);
+    return ((uint32_t)hi << 16) | lo;
+}
+
+//------------------------------------------------------------------------------
+// Info flash segment D: erase, then program word by word, an odd last byte
+// on its own.  Waits for the UART first, the CPU stalls while the flash is
+// busy (~15 ms for the erase).
+//------------------------------------------------------------------------------
+void hal_info_write(const void *data, uint8_t size)
+{
+    const uint16_t *src = (const uint16_t *)data;
+    uint16_t *dst = (uint16_t *)HAL_INFO_SEG_D;
+    hal_istate_t state;
+    uint8_t n;
+
+    if (size > HAL_INFO_SEG_SIZE)
+        return;
+    UART_tx_wait();                         // no bit may stall on the line
+
+    state = hal_irq_save();
+    FCTL2 = FWKEY + FSSEL_2 + FN1;          // SMCLK/3 = 333kHz at any MCLK
+    FCTL3 = FWKEY;                          // Clear LOCK
+    FCTL1 = FWKEY + ERASE;                  // Segment erase
+    *dst = 0;                               // Dummy write starts it
+    FCTL1 = FWKEY + WRT;                    // Word write
+    for (n = 0; n < size / 2; n++)
+        dst[n] = src[n];
+    if (size & 1)                           // no word read past the object
+        ((uint8_t *)dst)[size - 1] = ((const uint8_t *)data)[size - 1];
+    FCTL1 = FWKEY;                          // Clear WRT
+    FCTL3 = FWKEY + LOCK;                   // Set LOCK
+    hal_irq_restore(state);
+}
+
+//------------------------------------------------------------------------------
+// Ride log segments in main flash (log.h).  The erase stalls the CPU ~15 ms
+// with the UART idle, like the info segment; log.c asks for it with the
+// cranks still or well clear of the next cadence marker, and counts in the
+// carrier edges the capture latch could not hold meanwhile (srm_stall()).
+// Bytes go in one at a time with interrupts back on in
+// between, each a ~75 us stall: shorter than a 9600 baud bit, and the
+// Timer1_A capture latch holds the one edge that can come meanwhile.
+//------------------------------------------------------------------------------
+void hal_log_erase(uint16_t at)
+{
+    hal_istate_t state;
+
+    UART_tx_wait();                         // no bit may stall on the line
+
+    state = hal_irq_save();
+    FCTL2 = FWKEY + FSSEL_2 + FN1;          // SMCLK/3 = 333kHz at any MCLK
+    FCTL3 = FWKEY;                          // Clear LOCK
+    FCTL1 = FWKEY + ERASE;                  // Segment erase
+    *(uint8_t *)(uintptr_t)(HAL_LOG_BASE + at) = 0;  // Dummy write starts it
+    FCTL3 = FWKEY + LOCK;                   // Set LOCK
+    hal_irq_restore(state);
+}
+
+void hal_log_write(uint16_t at, const uint8_t *data, uint8_t size)
+{
+    uint8_t *dst = (uint8_t *)(uintptr_t)(HAL_LOG_BASE + at);
+    hal_istate_t state;
+
+    while (size--)
+    {
+        state = hal_irq_save();
+        FCTL2 = FWKEY + FSSEL_2 + FN1;      // SMCLK/3 = 333kHz at any MCLK
+        FCTL3 = FWKEY;                      // Clear LOCK
+        FCTL1 = FWKEY + WRT;                // Byte write
+        *dst++ = *data++;
+        FCTL1 = FWKEY;                      // Clear WRT
+        FCTL3 = FWKEY + LOCK;               // Set LOCK
+        hal_irq_restore(state);
+    }
+}
+
+#ifndef UART_USCI_A0
 //------------------------------------------------------------------------------
 // Function configures Timer_A for full-duplex UART operation
 //------------------------------------------------------------------------------
@@ -704,17 +617,41 @@ void TimerA_UART_init(void)
 }
 
 //------------------------------------------------------------------------------
-// Outputs one byte using the Timer_A UART
+// Loads the next queued byte into txData, returns 0 when the queue is empty
 //------------------------------------------------------------------------------
-void TimerA_UART_tx(unsigned char byte)
+static unsigned char TimerA_UART_next(void)
 {
-    while (TACCTL0 & CCIE);                 // Ensure last char got TX'd
-    TACCR0 = TAR;                           // Current state of TA counter
-    TACCR0 += UART_TBIT;                    // One bit time till first bit
-    TACCTL0 = OUTMOD0 + CCIE;               // Set TXD on EQU0, Int
+    int byte = txNextByte();
+
+    if (byte < 0)                           // Queue empty
+        return 0;
     txData = byte;                          // Load global variable
     txData |= 0x100;                        // Add mark stop bit to TXData
     txData <<= 1;                           // Add space start bit
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// Starts the Timer_A UART on the queue, call with interrupts disabled
+//------------------------------------------------------------------------------
+void TimerA_UART_tx_start(void)
+{
+    if (TACCTL0 & CCIE)                     // Busy, Timer_A0_ISR chains on
+        return;
+    if (!TimerA_UART_next())
+        return;
+    lpm_claim(LPM_UART_TX);                 // SMCLK until the queue drains
+    TACCR0 = TAR;                           // Current state of TA counter
+    TACCR0 += UART_TBIT;                    // One bit time till first bit
+    TACCTL0 = OUTMOD0 + CCIE;               // Set TXD on EQU0, Int
+}
+
+//------------------------------------------------------------------------------
+// Waits until every queued frame is on the line (startup only, never in ISRs)
+//------------------------------------------------------------------------------
+void TimerA_UART_tx_wait(void)
+{
+    while (TACCTL0 & CCIE);                 // Ensure last char got TX'd
 }
 
 //------------------------------------------------------------------------------
@@ -724,22 +661,30 @@ void TimerA_UART_tx(unsigned char byte)
 __interrupt void Timer_A0_ISR(void)
 {
     static unsigned char txBitCnt = 10;
+    PROF_ENTER(PROF_UART_TX);
 
+    PROF_LATENCY(PROF_UART_TX, profEntry - TACCR0);
     TACCR0 += UART_TBIT;                    // Add Offset to CCRx
-    if (txBitCnt == 0) {                    // All bits TXed
-        TACCTL0 &= ~CCIE;                   // All bits TXed, disable interrupt
+    if (txBitCnt == 0) {                    // All bits TXed, stop bit on the line
         txBitCnt = 10;                      // Re-load bit counter
+        if (!TimerA_UART_next()) {          // Queue drained
+            TACCTL0 &= ~CCIE;               // All bits TXed, disable interrupt
+            lpm_release(LPM_UART_TX);
+            energy_source(ENERGY_SRC_TIMER0);
+            __bic_SR_register_on_exit(LPM3_bits);   // main loop may go to LPM3
+            PROF_EXIT(PROF_UART_TX);
+            return;
+        }
+    }
+    if (txData & 0x01) {
+      TACCTL0 &= ~OUTMOD2;                  // TX Mark '1'
     }
     else {
-        if (txData & 0x01) {
-          TACCTL0 &= ~OUTMOD2;              // TX Mark '1'
-        }
-        else {
-          TACCTL0 |= OUTMOD2;               // TX Space '0'
-        }
-        txData >>= 1;
-        txBitCnt--;
+      TACCTL0 |= OUTMOD2;                   // TX Space '0'
     }
+    txData >>= 1;
+    txBitCnt--;
+    PROF_EXIT(PROF_UART_TX);
 }
 
 //------------------------------------------------------------------------------
@@ -750,9 +695,11 @@ __interrupt void Timer_A1_ISR(void)
 {
     static unsigned char rxBitCnt = 8;
     static unsigned char rxData = 0;
+    PROF_ENTER(PROF_UART_RX);
 
     switch (__even_in_range(TA0IV, TA0IV_TAIFG)) { // Use calculated branching
         case TA0IV_TACCR1:                         // TACCR1 CCIFG - UART RX
+            PROF_LATENCY(PROF_UART_RX, profEntry - TACCR1);
             TACCR1 += UART_TBIT;                   // Add Offset to CCRx
             if (TACCTL1 & CAP) {                   // Capture mode = start bit edge
                 TACCTL1 &= ~CAP;                   // Switch capture to compare mode
@@ -765,12 +712,95 @@ __interrupt void Timer_A1_ISR(void)
                 }
                 rxBitCnt--;
                 if (rxBitCnt == 0) {               // All bits RXed
-                    rxBuffer = rxData;             // Store in global variable
+                    rx_push(rxData);               // main loop parses it
+                    event_post(EV_RX);
                     rxBitCnt = 8;                  // Re-load bit counter
                     TACCTL1 |= CAP;                // Switch compare to capture mode
-                    __bic_SR_register_on_exit(LPM0_bits);  // Clear LPM0 bits from 0(SR)
+                    energy_source(ENERGY_SRC_TIMER0);
+                    __bic_SR_register_on_exit(LPM3_bits);  // Clear LPM bits from 0(SR)
                 }
             }
             break;
     }
+    PROF_EXIT(PROF_UART_RX);
+}
+
+#else // UART_USCI_A0
+
+//------------------------------------------------------------------------------
+// Function configures USCI_A0 for full-duplex UART operation, 8N1.  Timer_A
+// stays stopped unless ISR_PROFILE wants its count; nothing else uses it, the
+// OFFSETMODE tick and the slots are Timer1_A.
+//------------------------------------------------------------------------------
+void USCI_A0_UART_init(void)
+{
+    UCA0CTL1 |= UCSWRST;                    // Hold USCI in reset while set up
+    UCA0CTL1 |= UCSSEL_2;                   // SMCLK
+    UCA0BR0 = UART_UCBR & 0xFF;
+    UCA0BR1 = UART_UCBR >> 8;
+    UCA0MCTL = UART_UCBRS << 1;             // Modulation UCBRSx, UCOS16 = 0
+    UCA0CTL1 &= ~UCSWRST;                   // Release USCI
+    IE2 |= UCA0RXIE;                        // RX Int, TX Int only while sending
+#ifdef ISR_PROFILE
+    TACTL = TASSEL_2 + MC_2;                // Timer_A is free: 1us time base for prof.h
+#endif
+}
+
+//------------------------------------------------------------------------------
+// Starts USCI_A0 on the queue, call with interrupts disabled.  UCA0TXIFG is
+// set while UCA0TXBUF is empty, so enabling the interrupt sends the first byte.
+//------------------------------------------------------------------------------
+void USCI_A0_UART_tx_start(void)
+{
+    lpm_claim(LPM_UART_TX);                 // SMCLK until the queue drains
+    IE2 |= UCA0TXIE;                        // No-op if busy, USCI0TX_ISR chains on
+}
+
+//------------------------------------------------------------------------------
+// Waits until every queued frame is on the line (startup only, never in ISRs)
+//------------------------------------------------------------------------------
+void USCI_A0_UART_tx_wait(void)
+{
+    while (IE2 & UCA0TXIE);                 // Queue drained
+    while (UCA0STAT & UCBUSY);              // Last char shifted out
+}
+
+//------------------------------------------------------------------------------
+// USCI_A0 UART - Transmit Interrupt Handler, one per byte
+//------------------------------------------------------------------------------
+#pragma vector = USCIAB0TX_VECTOR
+__interrupt void USCI0TX_ISR(void)
+{
+    int byte;
+    PROF_ENTER(PROF_UART_TX);
+
+    byte = txNextByte();
+
+    if (byte < 0) {                         // Queue drained
+        IE2 &= ~UCA0TXIE;                   // Last char is still shifting out
+        lpm_release(LPM_UART_TX);           // main loop waits for UCBUSY first
+        energy_source(ENERGY_SRC_TIMER0);
+        __bic_SR_register_on_exit(LPM3_bits);   // main loop waits for UCBUSY
+        PROF_EXIT(PROF_UART_TX);
+        return;
+    }
+    UCA0TXBUF = byte;                       // Clears UCA0TXIFG
+    PROF_EXIT(PROF_UART_TX);
 }
+
+//------------------------------------------------------------------------------
+// USCI_A0 UART - Receive Interrupt Handler
+//------------------------------------------------------------------------------
+#pragma vector = USCIAB0RX_VECTOR
+__interrupt void USCI0RX_ISR(void)
+{
+    PROF_ENTER(PROF_UART_RX);
+
+    rx_push(UCA0RXBUF);                     // main loop parses it
+    event_post(EV_RX);
+    energy_source(ENERGY_SRC_TIMER0);
+    __bic_SR_register_on_exit(LPM3_bits);   // Clear LPM bits from 0(SR)
+    PROF_EXIT(PROF_UART_RX);
+}
+
+#endif // UART_USCI_A0
@@ -0,0 +1,889 @@
+//******************************************************************************
+//  ant.c - ANT message framing, TX frame queue and data pages
+//
+//  Pure protocol code: no register access, so the same file links into the
+//  MSP430 image and the host simulation (see hal.h).
+//******************************************************************************
+
+#include "hal.h"
+#include "ant.h"
+#include "srm.h"
+#include "cal.h"
+#include "power.h"
+#include "prof.h"
+#include "energy.h"
+#include "stack.h"
+#include "log.h"
+#include "lpm.h"
+
+txFrame_t txQueue[TX_QUEUE_SLOTS];
+volatile uint8_t txQueueHead;                 // free running, next slot to fill
+volatile uint8_t txQueueTail;                 // free running, slot on the line
+uint8_t txFramePos;                           // next byte of the tail frame
+uint16_t txQueueOverflow;                     // frames dropped, queue was full
+uint8_t txQueueHighWater;                     // most frames ever pending
+
+volatile uchar rxFifo[RX_FIFO_SIZE];
+volatile uint8_t rxHead;                      // free running, written by the RX ISR
+volatile uint8_t rxTail;                      // free running, written by antRxDrain()
+uint16_t rxOverflow;
+uint16_t rxBadFrames;
+
+static uchar rxMsg[RX_MSG_MAX + 2];           // size, id, payload
+static uint8_t rxPos;                         // 0 = hunting for sync
+static uchar rxSum;
+
+uint8_t antResponseSeq;
+uchar antResponseId;
+uchar antResponseCode;
+uint16_t antTxEvents;
+#ifdef ANT_CAD_CHANNEL
+uint16_t antCadTxEvents;
+#endif
+uint16_t antBootError;
+
+uint32_t antOpTime;
+static uint16_t antOpMark;                    // Timer1 count at the last slot
+static uint16_t antOpTicks;                   // Timer1 ticks not yet in antOpTime
+uint8_t antMainSent;
+static uint8_t antSinceCommon;                // slots since the last common page
+static uint8_t antSinceMain;                  // common pages since the last main page
+static uint8_t antCommonNext;                 // rotation through antCommonPages[]
+static uint8_t antMainNext;                   // rotation through antMainPages[mode]
+
+
+//------------------------------------------------------------------------------
+//  Queue slot for a new frame, NULL (and counted) when the queue is full.
+//  Main loop only.  The queue has this one producer and the UART transmit
+//  interrupt as its one consumer, which does not look at the slot until
+//  txPublish() moves the head past it, so the slot is filled with
+//  interrupts on.
+//------------------------------------------------------------------------------
+static txFrame_t *txReserve(void)
+{
+    if((uint8_t)(txQueueHead - txQueueTail) >= TX_QUEUE_SLOTS)
+    {
+        if(txQueueOverflow != 0xFFFF)
+            txQueueOverflow++;
+        return 0;
+    }
+    return &txQueue[txQueueHead & TX_QUEUE_MASK];
+}
+
+// Interrupts are held off for the head move and the UART kick only: the
+// frame is complete before the head moves, and the Timer_A UART start
+// must not be stretched by an ISR between reading TAR and arming CCR0.
+static void txPublish(txFrame_t *frame,uint8_t frameSize)
+{
+    hal_istate_t state;
+    uint8_t pending;
+
+    frame->size = frameSize;
+
+    state = hal_irq_save();
+    txQueueHead++;
+    UART_tx_start();                                       // no-op if already sending
+    hal_irq_restore(state);
+
+    pending = (uint8_t)(txQueueHead - txQueueTail);
+    if(pending > txQueueHighWater)
+        txQueueHighWater = pending;
+}
+
+//------------------------------------------------------------------------------
+//  TX: sync+size+id+head+body+sum, queued as one frame
+//
+//  Scatter-gather: the message is gathered from two pieces (e.g. a channel
+//  number and a page payload in flash) straight into a queue slot, the
+//  checksum built in the same pass, then the UART transmit interrupt sends
+//  it.  Constant time, main loop only (txReserve()).  A full queue drops
+//  the frame and counts it in txQueueOverflow.
+//------------------------------------------------------------------------------
+void txGather(uchar id,const uchar* head,uint8_t headSize,const uchar* body,uint8_t bodySize)
+{
+    txFrame_t *frame;
+    uchar *d;
+    uchar sum;
+    uint8_t size = headSize + bodySize;
+
+    if(size > TX_FRAME_MAX - 4)
+        return;
+
+    frame = txReserve();
+    if(frame)
+    {
+        d = frame->data;
+        *d++ = ANT_SYNC;                                   // sync byte
+        *d++ = size;                                       // message size - command size (1)
+        *d++ = id;
+        sum = ANT_SYNC ^ size ^ id;
+        while(headSize--)
+            sum ^= (*d++ = *head++);
+        while(bodySize--)
+            sum ^= (*d++ = *body++);
+        *d = sum;
+        txPublish(frame, ANT_FRAME_SIZE(size));
+    }
+}
+
+// message[0] is the id
+void txMessage(uchar* message,uint8_t messageSize)
+{
+    if(messageSize == 0)
+        return;
+    txGather(message[0], message + 1, messageSize - 1, 0, 0);
+}
+
+//------------------------------------------------------------------------------
+//  TX: a complete frame, checksum included (e.g. from flash), queued as is
+//------------------------------------------------------------------------------
+void txFrame(const uchar* frameData,uint8_t frameSize)
+{
+    txFrame_t *frame;
+    uint8_t i;
+
+    if(frameSize > TX_FRAME_MAX)
+        return;
+
+    frame = txReserve();
+    if(frame)
+    {
+        for(i=0; i<frameSize; i++)
+            frame->data[i] = frameData[i];
+        txPublish(frame, frameSize);
+    }
+}
+
+//------------------------------------------------------------------------------
+//  Next byte for the UART driver, -1 once the queue is empty and no ride
+//  log download is running.
+//  Only the UART transmit interrupt (or its host model) calls this.
+//------------------------------------------------------------------------------
+
+int txNextByte(void)
+{
+    txFrame_t *frame;
+    uchar byte;
+
+    if(txQueueTail == txQueueHead)                         // nothing queued
+        return logDownload ? log_download_byte() : -1;     // or the ride log (log.h)
+
+    frame = &txQueue[txQueueTail & TX_QUEUE_MASK];
+    byte = frame->data[txFramePos++];
+    if(txFramePos >= frame->size)                          // last byte taken, free the slot
+    {
+        txFramePos = 0;
+        txQueueTail++;
+    }
+    return byte;
+}
+
+//------------------------------------------------------------------------------
+//  ANT Data
+//------------------------------------------------------------------------------
+
+//------------------------------------------------------------------------------
+//  Boot configuration frames, complete with checksums, in flash
+//------------------------------------------------------------------------------
+static const uchar antBootStream[] = {
+    ANT_FRAME1(0x4A, 0x00),                                 // Reset module
+    ANT_FRAME9(MESG_NETWORK_KEY_ID, ANT_CH_ID,              // Network key, net# = ANT_CH_ID
+               ANT_NET_KEY0, ANT_NET_KEY1, ANT_NET_KEY2, ANT_NET_KEY3,
+               ANT_NET_KEY4, ANT_NET_KEY5, ANT_NET_KEY6, ANT_NET_KEY7),
+    ANT_FRAME3(0x42, ANT_CH_ID, ANT_CH_TYPE, ANT_NET_ID),   // Assign CH, CH Type=10(TX), Net#
+    ANT_FRAME2(0x45, ANT_CH_ID, ANT_CH_FREQ & 0xFF),        // RF frequency
+    ANT_FRAME3(0x43, ANT_CH_ID,                             // Channel period LSB, MSB
+               ANT_CH_PER & 0xFF, (ANT_CH_PER >> 8) & 0xFF),
+    ANT_FRAME5(0x51, ANT_CH_ID,                             // Channel ID: device number LSB, MSB,
+               ANT_DEV_ID1, ANT_DEV_ID2,                    // device type, transmission type
+               ANT_DEV_TYPE, ANT_TX_TYPE),
+    ANT_FRAME1(0x4B, ANT_CH_ID),                            // Open CH
+#ifdef ANT_CAD_CHANNEL
+    ANT_FRAME3(0x42, ANT_CAD_CH_ID, ANT_CH_TYPE, ANT_NET_ID),   // Cadence CH: assign, same network
+    ANT_FRAME2(0x45, ANT_CAD_CH_ID, ANT_CH_FREQ & 0xFF),    // RF frequency
+    ANT_FRAME3(0x43, ANT_CAD_CH_ID,                         // Channel period LSB, MSB
+               ANT_CAD_CH_PER & 0xFF, (ANT_CAD_CH_PER >> 8) & 0xFF),
+    ANT_FRAME5(0x51, ANT_CAD_CH_ID,                         // Channel ID, same device number
+               ANT_DEV_ID1, ANT_DEV_ID2,
+               ANT_CAD_DEV_TYPE, ANT_TX_TYPE),
+    ANT_FRAME1(0x4B, ANT_CAD_CH_ID),                        // Open CH
+#endif
+};
+
+// Start of each frame in antBootStream[], plus the end
+#define ANT_BOOT_AT_NETWORK     ANT_FRAME_SIZE(1)
+#define ANT_BOOT_AT_ASSIGN      (ANT_BOOT_AT_NETWORK + ANT_FRAME_SIZE(9))
+#define ANT_BOOT_AT_RF          (ANT_BOOT_AT_ASSIGN + ANT_FRAME_SIZE(3))
+#define ANT_BOOT_AT_PERIOD      (ANT_BOOT_AT_RF + ANT_FRAME_SIZE(2))
+#define ANT_BOOT_AT_CHID        (ANT_BOOT_AT_PERIOD + ANT_FRAME_SIZE(3))
+#define ANT_BOOT_AT_OPEN        (ANT_BOOT_AT_CHID + ANT_FRAME_SIZE(5))
+#define ANT_BOOT_AT_CAD         (ANT_BOOT_AT_OPEN + ANT_FRAME_SIZE(1))
+
+static const uint8_t antBootOffset[ANT_BOOT_FRAMES + 1] = {
+    0,
+    ANT_BOOT_AT_NETWORK,
+    ANT_BOOT_AT_ASSIGN,
+    ANT_BOOT_AT_RF,
+    ANT_BOOT_AT_PERIOD,
+    ANT_BOOT_AT_CHID,
+    ANT_BOOT_AT_OPEN,
+#ifdef ANT_CAD_CHANNEL
+    ANT_BOOT_AT_CAD,
+    ANT_BOOT_AT_CAD + ANT_FRAME_SIZE(3),
+    ANT_BOOT_AT_CAD + ANT_FRAME_SIZE(3) + ANT_FRAME_SIZE(2),
+    ANT_BOOT_AT_CAD + ANT_FRAME_SIZE(3) + ANT_FRAME_SIZE(2) + ANT_FRAME_SIZE(3),
+    ANT_BOOT_AT_CAD + ANT_FRAME_SIZE(3) + ANT_FRAME_SIZE(2) + ANT_FRAME_SIZE(3)
+        + ANT_FRAME_SIZE(5),
+#endif
+    sizeof(antBootStream),
+};
+
+// Queue boot frame n (ANT_BOOT_RESET..ANT_BOOT_FRAMES-1) straight from flash
+void antBootSend(uint8_t n)
+{
+    if(n >= ANT_BOOT_FRAMES)
+        return;
+    txFrame(&antBootStream[antBootOffset[n]],
+            antBootOffset[n + 1] - antBootOffset[n]);
+}
+
+
+//------------------------------------------------------------------------------
+//  EVENT_TX on the power channel: the AP1 has just put the page it holds on
+//  the air.  The next slot moves right behind it, as channel 1 is paced by
+//  its own EVENT_TX, so each page reaches the AP1 a whole period before it
+//  goes out and the slot timer follows the AP1's clock instead of drifting
+//  against it.  Drifting, a slot now and then lands on the broadcast: two
+//  pages in one period (the first never goes out) or none (the one before
+//  is repeated).  While idle the channel period is the slot period
+//  (antSetPeriod()), so this holds at either rate.
+//------------------------------------------------------------------------------
+static void antSlotSync(void)
+{
+    Timer1_A_slot_sync();
+    lpm_release(LPM_ANT_SYNC);                             // heard it
+}
+
+//------------------------------------------------------------------------------
+//  Channel period of the power channel, ANT_CH_PER * div: lpm_slot() asks
+//  for the longer one while the slots run LPM_IDLE_DIV periods apart, so
+//  the AP1 broadcasts only as often as a new page comes.  A receiver at the
+//  ANT+ period still hears every div-th of its own slots and stays paired.
+//  The AP1 takes the period on the open channel; its response is not
+//  waited for (the Timer_A UART may well sleep through it).
+//------------------------------------------------------------------------------
+void antSetPeriod(uint8_t div)
+{
+    uint16_t period = (uint16_t)ANT_CH_PER * div;
+    uchar msg[3];
+
+    msg[0] = ANT_CH_ID;
+    msg[1] = period & 0xFF;                                // LSB, MSB
+    msg[2] = period >> 8;
+    txGather(0x43, msg, 3, 0, 0);                          // Channel period
+}
+
+//------------------------------------------------------------------------------
+//  RX: sync, size, id, payload, checksum, one byte at a time.  Any bad size
+//  or checksum drops the frame and goes back to hunting for the sync byte.
+//------------------------------------------------------------------------------
+static void antRxMessage(uchar id, const uchar *data, uint8_t size)
+{
+    if(id == MESG_RESPONSE_EVENT_ID && size >= 3)
+    {
+        if(data[1] == MESG_EVENT_ID)                       // channel event
+        {
+            if(data[2] != EVENT_TX)
+                return;
+#ifdef ANT_CAD_CHANNEL
+            if(data[0] == ANT_CAD_CH_ID)                   // the AP1 wants its next page
+            {
+                antCadTxEvents++;
+                sendCadence();
+                return;
+            }
+#endif
+            antTxEvents++;
+            antSlotSync();
+            return;
+        }
+        antResponseId   = data[1];                         // response to a command
+        antResponseCode = data[2];
+        antResponseSeq++;
+    }
+    else if(id == MESG_STARTUP_MESG_ID)                    // reset done
+    {
+        antResponseId   = MESG_SYSTEM_RESET_ID;
+        antResponseCode = RESPONSE_NO_ERROR;
+        antResponseSeq++;
+    }
+}
+
+static void antRxByte(uchar byte)
+{
+    if(rxPos == 0)
+    {
+        if(byte == ANT_SYNC)
+        {
+            rxSum = byte;
+            rxPos = 1;
+        }
+        return;
+    }
+
+    if(rxPos == 1 && byte > RX_MSG_MAX)                    // too long for us
+    {
+        rxBadFrames++;
+        rxPos = 0;
+        return;
+    }
+
+    if(rxPos == rxMsg[0] + 3)                              // checksum byte
+    {
+        if(rxSum == byte)
+            antRxMessage(rxMsg[1], &rxMsg[2], rxMsg[0]);
+        else
+            rxBadFrames++;
+        rxPos = 0;
+        return;
+    }
+
+    rxMsg[rxPos - 1] = byte;
+    rxSum ^= byte;
+    rxPos++;
+}
+
+//------------------------------------------------------------------------------
+//  Parse every received byte, main loop only
+//------------------------------------------------------------------------------
+void antRxDrain(void)
+{
+    uint8_t tail = rxTail;
+
+    while(tail != rxHead)
+    {
+        antRxByte(rxFifo[tail & RX_FIFO_MASK]);
+        rxTail = ++tail;                       // slot free for the ISR again
+    }
+}
+
+//------------------------------------------------------------------------------
+//  Boot: send each configuration frame and move on as soon as the module
+//  answers it.  Startup code only, polls with interrupts enabled.
+//
+//  A command that is refused or not answered within ANT_BOOT_TIMEOUT is
+//  sent again, up to ANT_BOOT_TRIES times.  Not every AP1 sends a startup
+//  message after a reset, so the reset waits for the startup message or
+//  ANT_RESET_TIMEOUT and carries on either way.  That time only starts once
+//  the reset frame is off the line: at 4800 baud the frame alone takes
+//  10.4 ms, and the AP1 needs its post-reset time before the next byte.  Returns ANT_BOOT_FRAMES when the channel is
+//  open, otherwise the frame that failed (details in antBootError).
+//------------------------------------------------------------------------------
+#define ANT_BOOT_TIMEOUT    100               // ms per try, frame on the line included
+#define ANT_RESET_TIMEOUT   10                // ms after the reset frame
+#define ANT_BOOT_TRIES      3
+
+static uchar antWaitResponse(uchar id, uint8_t seq, uint16_t ms)
+{
+    uint16_t t;
+
+    for(t = 0; t < ms * 10; t++)
+    {
+        antRxDrain();
+        if(antResponseSeq != seq && antResponseId == id)
+            return antResponseCode;
+        hal_delay_100us();
+    }
+    return RESPONSE_TIMEOUT;
+}
+
+uint8_t antBoot(void)
+{
+    uint8_t n;
+    uint8_t tries;
+    uchar id;
+    uchar code;
+
+    for(n = 0; n < ANT_BOOT_FRAMES; n++)
+    {
+        id = antBootStream[antBootOffset[n] + 2];
+        for(tries = 0; tries < ANT_BOOT_TRIES; tries++)
+        {
+            uint8_t seq = antResponseSeq;
+
+            antBootSend(n);
+            if(id == MESG_SYSTEM_RESET_ID)
+            {
+                UART_tx_wait();                            // frame on the line first
+                antWaitResponse(id, seq, ANT_RESET_TIMEOUT);
+                code = RESPONSE_NO_ERROR;
+                break;
+            }
+            code = antWaitResponse(id, seq, ANT_BOOT_TIMEOUT);
+            if(code == RESPONSE_NO_ERROR)
+                break;
+            antBootError = ((uint16_t)n << 8) | code;
+        }
+        if(code != RESPONSE_NO_ERROR)
+            return n;
+    }
+    return ANT_BOOT_FRAMES;
+}
+
+/////////////////////////////////////////////////////////////////////////
+// Priority:
+//
+// ucPower_:   0 = TX Power -20dBM
+//             1 = TX Power -10dBM
+//             2 = TX Power -5dBM
+//             3 = TX Power 0dBM
+//
+/////////////////////////////////////////////////////////////////////////
+/*
+void ChannelPower()
+{
+        uchar setup[3];
+        setup[0] = 0x47;
+        setup[1] = 0x00;
+        setup[2] = 0x03;
+
+
+        txMessage(setup, 3);
+}
+*/
+
+//------------------------------------------------------------------------------
+//  Broadcast data pages: A4 09 4E ch | antPage_t | checksum
+//
+//  Encoders fill the typed page in place in the queue slot, folding each
+//  byte into the checksum as it is written (sum ^= (field = value)).  The
+//  header bytes come from a flash template, then the channel number, and the
+//  checksum of the header and of each page's constant bytes is worked out by
+//  the compiler.
+//  Values that must match each other (event count, time stamp, torque
+//  ticks) come from the producer's snapshot (snap.h), copied out before the
+//  page is built, so interrupts stay on throughout.
+//------------------------------------------------------------------------------
+#define ANT_PAGE_SUM    (ANT_SYNC ^ 9 ^ MESG_BROADCAST_DATA_ID ^ ANT_CH_ID)
+
+static const uchar antPageHeader[3] = {
+    ANT_SYNC, 9, MESG_BROADCAST_DATA_ID
+};
+
+// Payload of the next queue slot with the header in, NULL when full
+static antPage_t *txPageOpenCh(uchar channel)
+{
+    txFrame_t *frame = txReserve();
+
+    if(!frame)
+        return 0;
+    frame->data[0] = antPageHeader[0];
+    frame->data[1] = antPageHeader[1];
+    frame->data[2] = antPageHeader[2];
+    frame->data[3] = channel;
+    return (antPage_t *)&frame->data[4];
+}
+
+static antPage_t *txPageOpen(void)
+{
+    return txPageOpenCh(ANT_CH_ID);
+}
+
+static void txPageClose(uchar sum)
+{
+    txFrame_t *frame = &txQueue[txQueueHead & TX_QUEUE_MASK];
+
+    frame->data[ANT_FRAME_SIZE(9) - 1] = sum;
+    txPublish(frame, ANT_FRAME_SIZE(9));
+}
+
+// Sends sendPower_n: standard power only, values from power.c
+#define PAGE10_SUM      (ANT_PAGE_SUM ^ 0x10 ^ 0xFF)
+
+void sendPower_n(void)
+{
+    powerSnap_t v;
+    antPage_t *p;
+    uchar sum = PAGE10_SUM;
+
+    power_snapshot(&v);
+    p = txPageOpen();
+    if(p)
+    {
+        p->power.page        = 0x10;                        // 0x10 Data Page Number
+        sum ^= (p->power.event       = v.event);            //Event Count max256, one per revolution
+        p->power.pedalPower  = 0xFF;                        //Pedal Power 0xFF > pedal power not used
+        sum ^= (p->power.cadence     = v.cadence);          //Instantaneous Cadence rpm, 0xFF invalid
+        sum ^= (p->power.accPowerLsb = (uchar)v.accWatts);            //Accumulated Power LSB
+        sum ^= (p->power.accPowerMsb = (uchar)(v.accWatts >> 8));     //Accumulated Power MSB
+        sum ^= (p->power.powerLsb    = (uchar)v.watts);               //Instantaneous Power LSB
+        sum ^= (p->power.powerMsb    = (uchar)(v.watts >> 8));        //Instantaneous Power MSB
+        txPageClose(sum);
+    }
+}
+
+// Sends sendPower_SCT: standard crank torque, values from power.c
+#define PAGE12_SUM      (ANT_PAGE_SUM ^ 0x12)
+
+void sendPower_SCT(void)
+{
+    powerSnap_t v;
+    antPage_t *p;
+    uchar sum = PAGE12_SUM;
+
+    power_snapshot(&v);
+    p = txPageOpen();
+    if(p)
+    {
+        p->torque.page         = 0x12;                            //0x12 Data Page Number Standard Crank Torque
+        sum ^= (p->torque.event        = v.event);                //Event Count max256, one per revolution
+        sum ^= (p->torque.revolutions  = v.event);                //Crank Ticks, one per revolution
+        sum ^= (p->torque.cadence      = v.cadence);              //Instantaneous Cadence rpm, 0xFF invalid
+        sum ^= (p->torque.accPeriodLsb = (uchar)v.accPeriod);           //Accumulated Period LSB 1/2048s
+        sum ^= (p->torque.accPeriodMsb = (uchar)(v.accPeriod >> 8));    //Accumulated Period MSB
+        sum ^= (p->torque.accTorqueLsb = (uchar)v.accTorque);           //Accumulated Torque LSB 1/32Nm
+        sum ^= (p->torque.accTorqueMsb = (uchar)(v.accTorque >> 8));    //Accumulated Torque MSB
+        txPageClose(sum);
+    }
+}
+
+// Sends sendPower_CTF1
+#define PAGE20_SUM      (ANT_PAGE_SUM ^ 0x20)
+
+void sendPower_CTF1()
+{
+    srmSnap_t v;
+    antPage_t *p;
+    uchar sum = PAGE20_SUM;
+
+    srm_snapshot(&v);
+    p = txPageOpen();
+    if(p)
+    {
+        p->ctf.page            = 0x20;                                  //0x20 Data Page Number Crank Torque Frequency
+        sum ^= (p->ctf.event          = (uchar)v.revolutions);          //Rotation event counter increments with each completed pedal revolution.
+        sum ^= (p->ctf.slopeMsb       = (uchar)(ctfSlope >> 8));        //Slope MSB 1/10 Nm/Hz, info flash
+        sum ^= (p->ctf.slopeLsb       = (uchar)ctfSlope);               //Slope LSB 1/10 Nm/Hz
+        sum ^= (p->ctf.timeStampMsb   = (uchar)(v.timeStamp >> 8));     //Accumulated Time Stamp MSB 1/2000s
+        sum ^= (p->ctf.timeStampLsb   = (uchar)v.timeStamp);            //Accumulated Time Stamp LSB 1/2000s
+        sum ^= (p->ctf.torqueTicksMsb = (uchar)(v.torqueTicks >> 8));   //Accumulated Torque Ticks Stamp MSB
+        sum ^= (p->ctf.torqueTicksLsb = (uchar)v.torqueTicks);          //Accumulated Torque Ticks Stamp LSB
+        txPageClose(sum);
+    }
+}
+
+// Sends sendPower_CTF1_Calibration
+#define PAGE01_CTF_SUM  (ANT_PAGE_SUM ^ 0x01 ^ 0x10 ^ 0x01 ^ 0xFF ^ 0xFF ^ 0xFF)
+
+void sendPower_CTF1_CAL()
+{
+    antPage_t *p = txPageOpen();
+    uchar sum = PAGE01_CTF_SUM;
+
+    if(p)
+    {
+        p->cal.page            = 0x01;                              //Data page Number : Calibration massage
+        p->cal.calId           = 0x10;                              //Calibration ID : CTF defined massage
+        p->cal.ctfId           = 0x01;                              //CTF Defined ID : Zero offset
+        p->cal.reserved[0]     = 0xFF;                              //Reserved :
+        p->cal.reserved[1]     = 0xFF;
+        p->cal.reserved[2]     = 0xFF;
+        sum ^= (p->cal.offsetMsb      = (uchar)(zeroOffset >> 8));  //Offset MSB, Hz
+        sum ^= (p->cal.offsetLsb      = (uchar)zeroOffset);         //Offset LSB
+        txPageClose(sum);
+    }
+}
+
+#ifdef ANT_CAD_CHANNEL
+//------------------------------------------------------------------------------
+//  Bike cadence page 0x00 on ANT_CAD_CH_ID, legacy layout (no toggle bit,
+//  no background pages).  Time and count of the last revolution srm.c saw;
+//  the extended Timer1 count is 1/4096 s, so /4 is exactly 1/1024 s.
+//------------------------------------------------------------------------------
+#define PAGECAD_SUM     (ANT_SYNC ^ 9 ^ MESG_BROADCAST_DATA_ID ^ ANT_CAD_CH_ID ^ 0x00 \
+                         ^ 0xFF ^ 0xFF ^ 0xFF)
+
+void sendCadence()
+{
+    srmSnap_t v;
+    antPage_t *p;
+    uint16_t eventTime;
+    uchar sum = PAGECAD_SUM;
+
+    srm_snapshot(&v);
+    eventTime = (uint16_t)(v.eventTime >> 2);
+    p = txPageOpenCh(ANT_CAD_CH_ID);
+    if(p)
+    {
+        p->cadence.page        = 0x00;                              //Data page 0, legacy
+        p->cadence.reserved[0] = 0xFF;                              //Reserved
+        p->cadence.reserved[1] = 0xFF;
+        p->cadence.reserved[2] = 0xFF;
+        sum ^= (p->cadence.eventTimeLsb   = (uchar)eventTime);              //Cadence event time LSB 1/1024s
+        sum ^= (p->cadence.eventTimeMsb   = (uchar)(eventTime >> 8));       //Cadence event time MSB
+        sum ^= (p->cadence.revolutionsLsb = (uchar)v.revolutions);          //Cumulative revolutions LSB
+        sum ^= (p->cadence.revolutionsMsb = (uchar)(v.revolutions >> 8));   //Cumulative revolutions MSB
+        txPageClose(sum);
+    }
+}
+#endif // ANT_CAD_CHANNEL
+
+//------------------------------------------------------------------------------
+//  Common pages.  0x50 and 0x51 never change, so they live in flash and go
+//  out gathered behind the channel number; 0x52 carries the operating time.
+//------------------------------------------------------------------------------
+static const uchar antChannel[1] = { ANT_CH_ID };
+
+static const uchar antPage50[8] = {
+    0x50,                                               //Manufacturer's Information
+    0xFF,                                               //Reserved
+    0xFF,                                               //Reserved
+    ANT_HW_REVISION,                                    //HW Revision
+    ANT_MANUFACTURER_ID & 0xFF,                         //Manufacturer ID LSB
+    (ANT_MANUFACTURER_ID >> 8) & 0xFF,                  //Manufacturer ID MSB
+    ANT_MODEL_NUMBER & 0xFF,                            //Model Number LSB
+    (ANT_MODEL_NUMBER >> 8) & 0xFF,                     //Model Number MSB
+};
+
+static const uchar antPage51[8] = {
+    0x51,                                               //Product Information
+    0xFF,                                               //Reserved
+    0xFF,                                               //SW Revision supplemental, not used
+    ANT_SW_REVISION,                                    //SW Revision main
+    ANT_SERIAL_NUMBER & 0xFF,                           //Serial Number LSB
+    (ANT_SERIAL_NUMBER >> 8) & 0xFF,
+    (ANT_SERIAL_NUMBER >> 16) & 0xFF,
+    (ANT_SERIAL_NUMBER >> 24) & 0xFF,                   //Serial Number MSB
+};
+
+void sendManufacturerInfo()
+{
+    txGather(MESG_BROADCAST_DATA_ID, antChannel, sizeof(antChannel), antPage50, sizeof(antPage50));
+}
+
+void sendProductInfo()
+{
+    txGather(MESG_BROADCAST_DATA_ID, antChannel, sizeof(antChannel), antPage51, sizeof(antPage51));
+}
+
+// Sends battery status: no battery measurement, operating time only
+#define PAGE52_SUM      (ANT_PAGE_SUM ^ 0x52 ^ 0xFF ^ 0xFF ^ 0xFF ^ 0xFF)
+
+void sendBatteryStatus()
+{
+    antPage_t *p = txPageOpen();
+    uint32_t opTime = antOpTime;
+    uchar sum = PAGE52_SUM;
+
+    if(p)
+    {
+        p->battery.page        = 0x52;                      //Battery Status
+        p->battery.reserved    = 0xFF;                      //Reserved
+        p->battery.batteryId   = 0xFF;                      //Battery identifier, not used
+        sum ^= (p->battery.opTime[0] = (uchar)opTime);      //Cumulative operating time LSB
+        sum ^= (p->battery.opTime[1] = (uchar)(opTime >> 8));
+        sum ^= (p->battery.opTime[2] = (uchar)(opTime >> 16));  //Cumulative operating time MSB
+        p->battery.voltageFrac = 0xFF;                      //Fractional voltage, invalid
+        p->battery.descriptive = 0xFF;                      //2 s resolution, status and coarse V invalid
+        txPageClose(sum);
+    }
+}
+
+#ifndef ISR_PROFILE
+//------------------------------------------------------------------------------
+//  Energy account, manufacturer specific page 0xF1.  Each call sends the
+//  next half of one wake-up source's figures: time in each state, then the
+//  charge, so ENERGY_SOURCES * 2 pages cover them all.
+//------------------------------------------------------------------------------
+#define PAGEF1_SUM      (ANT_PAGE_SUM ^ 0xF1)
+
+static uint8_t energyNext;                                  // source << 1 | part
+
+void sendEnergyAccount()
+{
+    antPage_t *p = txPageOpen();
+    uint8_t src = energyNext >> 1;
+    uint16_t v[3];
+    uchar sum = PAGEF1_SUM;
+    uint8_t i;
+
+    if(p)
+    {
+        if(energyNext & 1)
+        {
+            uint32_t charge = energy_charge(src);
+
+            v[0] = (uint16_t)charge;
+            v[1] = (uint16_t)(charge >> 16);
+            v[2] = 0xFFFF;
+        }
+        else
+            for(i = 0; i < ENERGY_STATES; i++)
+                v[i] = energyTime[src][i];                      // 1/16 s
+
+        p->energy.page           = 0xF1;                    //Energy account
+        sum ^= (p->energy.select = energyNext);             //Source and part
+        for(i = 0; i < 3; i++)
+        {
+            sum ^= (p->energy.value[2 * i]     = (uchar)v[i]);          //LSB
+            sum ^= (p->energy.value[2 * i + 1] = (uchar)(v[i] >> 8));   //MSB
+        }
+        txPageClose(sum);
+        if(++energyNext >= ENERGY_SOURCES * 2)
+            energyNext = 0;
+    }
+}
+#endif // ISR_PROFILE
+
+//------------------------------------------------------------------------------
+//  Memory status, manufacturer specific page 0xF2: stack high-water mark
+//  (probed here, in the main loop) and the TX queue high-water mark.
+//------------------------------------------------------------------------------
+#define PAGEF2_SUM      (ANT_PAGE_SUM ^ 0xF2 ^ 0xFF ^ 0xFF)
+
+void sendMemoryStatus()
+{
+    antPage_t *p;
+    uchar sum = PAGEF2_SUM;
+
+    stack_probe();
+
+    p = txPageOpen();
+    if(p)
+    {
+        p->memory.page         = 0xF2;                      //Memory status
+        p->memory.reserved     = 0xFF;
+        sum ^= (p->memory.stackSizeLsb = (uchar)stackSize);         //Stack region LSB
+        sum ^= (p->memory.stackSizeMsb = (uchar)(stackSize >> 8));  //Stack region MSB
+        sum ^= (p->memory.stackUsedLsb = (uchar)stackUsed);         //Stack high-water LSB
+        sum ^= (p->memory.stackUsedMsb = (uchar)(stackUsed >> 8));  //Stack high-water MSB
+        sum ^= (p->memory.txQueueHighWater = txQueueHighWater);     //TX queue high-water
+        p->memory.reserved2    = 0xFF;
+        txPageClose(sum);
+    }
+}
+
+#ifdef ISR_PROFILE
+//------------------------------------------------------------------------------
+//  ISR profile, manufacturer specific page 0xF0.  Each call sends the next
+//  half of one histogram: buckets 0-5, then buckets 6-7 and, for the run
+//  time, profMax of the vector.  PROF_ISRS * PROF_KINDS * 2 pages for the
+//  set; bytes past the last value are 0xFF.
+//------------------------------------------------------------------------------
+#define PAGEF0_SUM      (ANT_PAGE_SUM ^ 0xF0)
+
+static uint8_t profNext;                                    // isr << 2 | kind << 1 | part
+
+void sendIsrProfile()
+{
+    antPage_t *p = txPageOpen();
+    uint8_t isr = profNext >> 2;
+    uint8_t kind = (profNext >> 1) & 1;
+    uint8_t n = (profNext & 1) * 6;
+    uchar sum = PAGEF0_SUM;
+    uchar b;
+    uint8_t i;
+
+    if(p)
+    {
+        p->prof.page           = 0xF0;                      //ISR profile
+        sum ^= (p->prof.select = (uchar)(isr << 3 | kind << 2 | n / 6));  //Vector, histogram and part
+        for(i = 0; i < 6; i++, n++)
+        {
+            b = 0xFF;
+            if(n < PROF_BUCKETS)
+                b = profHist[isr][kind][n];                 //Bucket count
+            else if(kind == PROF_EXEC && n < PROF_BUCKETS + 2)
+                b = (uchar)(profMax[isr] >> ((n - PROF_BUCKETS) * 8));  //Longest run, us, LSB first
+            sum ^= (p->prof.value[i] = b);
+        }
+        txPageClose(sum);
+        if(++profNext >= PROF_ISRS * PROF_KINDS * 2)
+            profNext = 0;
+    }
+}
+#endif // ISR_PROFILE
+
+//------------------------------------------------------------------------------
+//  Page multiplexer, one page per channel period slot (EV_SLOT)
+//
+//  The main page of the current mode goes out whenever srm has something
+//  new for it.  In CTMMODE that is 0x20 every other time, with 0x10 and
+//  0x12 taking turns in between: 0x20 carries the raw crank torque
+//  frequency for head units that decode it, 0x10 and 0x12 carry the watts
+//  and torque power.c derives from it, for those that do not.  Until the
+//  first calibration (zeroOffset 0) there is no torque to derive them from,
+//  and 0 W would read as a real value, so CTMMODE sends only 0x20.  A slot that would only
+//  repeat it carries the next common page instead, but a stale main page
+//  still goes out every ANT_MAIN_EVERY slots so receivers see the cranks
+//  stop.  Common pages are forced often enough that the whole rotation
+//  fits in ANT_COMMON_ROUND slots, inside the ANT+ limit of one every 121
+//  messages for 0x50 and 0x51.
+//------------------------------------------------------------------------------
+static void (* const antMainPages[][ANT_MAIN_PAGES])(void) = {
+    { sendPower_CTF1, sendPower_CTF1,
+      sendPower_CTF1, sendPower_CTF1 },                               // CTMMODE, not calibrated
+    { sendPower_CTF1, sendPower_n, sendPower_CTF1, sendPower_SCT },   // CTMMODE
+    { sendPower_CTF1_CAL, sendPower_CTF1_CAL,
+      sendPower_CTF1_CAL, sendPower_CTF1_CAL },                       // OFFSETMODE
+};
+
+static void (* const antCommonPages[])(void) = {
+    sendManufacturerInfo,
+    sendProductInfo,
+    sendBatteryStatus,
+#ifdef ISR_PROFILE
+    sendIsrProfile,                                     // debug builds, in place of 0xF1
+#else
+    sendEnergyAccount,
+#endif
+    sendMemoryStatus,
+};
+
+#define ANT_COMMON_PAGES    (sizeof(antCommonPages) / sizeof(antCommonPages[0]))
+#define ANT_COMMON_INTERVAL ((uint8_t)(ANT_COMMON_ROUND / ANT_COMMON_PAGES))
+
+//------------------------------------------------------------------------------
+// Operating time from the Timer1 count: slots run lpmSlotDiv periods apart
+// when idle, so counting them would not do.  Slots are never more than a
+// second apart while Timer1_A runs, far inside its 16 s wrap.  In LPM4
+// Timer1_A stands still with every other clock, so those sleeps, at next to
+// no current, are not counted.
+//------------------------------------------------------------------------------
+static void antOpTick(void)
+{
+    uint16_t now = hal_timer1_now();
+    uint16_t lap = now - antOpMark;
+
+    antOpMark = now;
+    antOpTime += lap >> 13;                                 // 8192 ticks: 2 s
+    antOpTicks += lap & 0x1FFF;
+    if(antOpTicks >= 0x2000)
+    {
+        antOpTicks -= 0x2000;
+        antOpTime++;
+    }
+}
+
+void antSlot(void)
+{
+    uint8_t fresh = (srmDataSeq != antMainSent);
+
+    antOpTick();
+    if(antSinceCommon + 1 >= ANT_COMMON_INTERVAL
+       || (!fresh && antSinceMain + 1 < ANT_MAIN_EVERY))
+    {
+        antCommonPages[antCommonNext]();
+        if(++antCommonNext >= ANT_COMMON_PAGES)
+            antCommonNext = 0;
+        antSinceCommon = 0;
+        antSinceMain++;
+        return;
+    }
+
+    antMainSent = srmDataSeq;
+    antMainPages[unqomode == CTMMODE && zeroOffset == 0 ? 0 : unqomode][antMainNext]();
+    antMainNext = (antMainNext + 1) & (ANT_MAIN_PAGES - 1);
+    antSinceMain = 0;
+    antSinceCommon++;
+}
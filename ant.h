@@ -0,0 +1,317 @@
+//******************************************************************************
+//  ant.h - ANT message framing, TX frame queue and data pages
+//******************************************************************************
+#ifndef ANT_H
+#define ANT_H
+
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// ANT Data
+//------------------------------------------------------------------------------
+#define MESG_NETWORK_KEY_ID      0x46
+#define MESG_NETWORK_KEY_SIZE       9
+#define ANT_CH_ID    0x00
+#define ANT_CH_TYPE  0x10     //Master (0x10)
+#define ANT_NET_ID   0x00
+#define ANT_DEV_ID1  0x31     //49
+#define ANT_DEV_ID2  0x00
+#define ANT_DEV_TYPE 0x0B     // Device Type, HRM=0x78, Power=0x0B(11)
+#define ANT_TX_TYPE  0x05     //ANT+ devices follow the transmission type definition as outlined in the ANT protocol.
+#define ANT_CH_FREQ  0x0039   //   2457MHz
+#define ANT_CH_PER   0x1FF6   //0x1FF6 8182/32768=4.004888780Hz // 0x1FA6 8102/32768=4.044Hz  8192/32768=4Hz
+#define ANT_SYNC_TICKS  4     // slot after an EVENT_TX on ANT_CH_ID, Timer1 ticks (~1 ms)
+
+//------------------------------------------------------------------------------
+// Optional second channel: bike cadence sensor profile, for head units that
+// ignore the cadence in the power pages.  Same device number, own channel,
+// period and device type.  The AP1 asks for each page with EVENT_TX on this
+// channel, so its pages go out at its own period, between the power pages.
+// With the Timer_A UART the start bit of each EVENT_TX needs SMCLK, so that
+// build never sleeps below LPM0 (lpm.h: LPM_UART_RX); UART_USCI_A0 does not.
+//------------------------------------------------------------------------------
+//#define ANT_CAD_CHANNEL
+#define ANT_CAD_CH_ID    0x01
+#define ANT_CAD_DEV_TYPE 0x7A     // Device Type, Bike Cadence=0x7A(122)
+#define ANT_CAD_CH_PER   0x1FA6   // 8102/32768=4.044Hz
+
+// ANT+ network key, visit thisisant.com and make a free account
+#define ANT_NET_KEY0 0x00
+#define ANT_NET_KEY1 0x00
+#define ANT_NET_KEY2 0x00
+#define ANT_NET_KEY3 0x00
+#define ANT_NET_KEY4 0x00
+#define ANT_NET_KEY5 0x00
+#define ANT_NET_KEY6 0x00
+#define ANT_NET_KEY7 0x00
+
+
+//Common pages 0x50/0x51
+#define ANT_HW_REVISION      0x01
+#define ANT_MANUFACTURER_ID  0x00FF   // 255 = development
+#define ANT_MODEL_NUMBER     0x0001
+#define ANT_SW_REVISION      0x01
+#define ANT_SERIAL_NUMBER    0xFFFFFFFFUL   // none
+
+typedef uint8_t uchar;
+
+//------------------------------------------------------------------------------
+// Frame layout: sync, size (data bytes after the id), id, data, checksum.
+// ANT_FRAMEn(id, data...) expands to a whole frame, checksum included, for
+// constant initializers.
+//------------------------------------------------------------------------------
+#define ANT_SYNC                 0xA4
+#define MESG_BROADCAST_DATA_ID   0x4E
+#define MESG_RESPONSE_EVENT_ID   0x40
+#define MESG_STARTUP_MESG_ID     0x6F
+#define MESG_SYSTEM_RESET_ID     0x4A
+#define MESG_EVENT_ID            0x01         // message id field of a channel event
+
+#define RESPONSE_NO_ERROR        0x00
+#define EVENT_TX                 0x03
+#define RESPONSE_TIMEOUT         0xFF         // no answer from the module (local code)
+
+#define ANT_FRAME_SIZE(n)        ((n) + 4)
+
+#define ANT_FRAME1(id,a) \
+    ANT_SYNC, 1, id, a, (uchar)(ANT_SYNC ^ 1 ^ (id) ^ (a))
+#define ANT_FRAME2(id,a,b) \
+    ANT_SYNC, 2, id, a, b, (uchar)(ANT_SYNC ^ 2 ^ (id) ^ (a) ^ (b))
+#define ANT_FRAME3(id,a,b,c) \
+    ANT_SYNC, 3, id, a, b, c, (uchar)(ANT_SYNC ^ 3 ^ (id) ^ (a) ^ (b) ^ (c))
+#define ANT_FRAME5(id,a,b,c,d,e) \
+    ANT_SYNC, 5, id, a, b, c, d, e, \
+    (uchar)(ANT_SYNC ^ 5 ^ (id) ^ (a) ^ (b) ^ (c) ^ (d) ^ (e))
+#define ANT_FRAME9(id,a,b,c,d,e,f,g,h,i) \
+    ANT_SYNC, 9, id, a, b, c, d, e, f, g, h, i, \
+    (uchar)(ANT_SYNC ^ 9 ^ (id) ^ (a) ^ (b) ^ (c) ^ (d) ^ (e) ^ (f) ^ (g) ^ (h) ^ (i))
+
+//------------------------------------------------------------------------------
+// Boot configuration, in the order main() sends it
+//------------------------------------------------------------------------------
+enum{
+    ANT_BOOT_RESET = 0,
+    ANT_BOOT_NETWORK,
+    ANT_BOOT_ASSIGN,
+    ANT_BOOT_RF,
+    ANT_BOOT_PERIOD,
+    ANT_BOOT_CHID,
+    ANT_BOOT_OPEN,
+#ifdef ANT_CAD_CHANNEL
+    ANT_BOOT_CAD_ASSIGN,
+    ANT_BOOT_CAD_RF,
+    ANT_BOOT_CAD_PERIOD,
+    ANT_BOOT_CAD_CHID,
+    ANT_BOOT_CAD_OPEN,
+#endif
+    ANT_BOOT_FRAMES
+};
+
+//------------------------------------------------------------------------------
+// TX frame queue: whole ANT frames, drained byte by byte by Timer_A0_ISR.
+// 4 frames deep (56 bytes): one page a slot needs 1, 2 with the cadence
+// channel.  8 would cost another 56 bytes the ISR_PROFILE build does not have.
+//------------------------------------------------------------------------------
+#define TX_FRAME_MAX        13                // sync + size + id + 9 data + checksum
+#define TX_QUEUE_SLOTS      4                 // power of two; 2 used with ANT_CAD_CHANNEL
+#define TX_QUEUE_MASK       (TX_QUEUE_SLOTS - 1)
+
+typedef struct {
+    uint8_t size;                             // bytes used in data[]
+    uchar   data[TX_FRAME_MAX];
+} txFrame_t;
+
+//------------------------------------------------------------------------------
+// Broadcast data pages: the 8 bytes after the channel number, in wire order.
+// Byte fields only, so the layout is packed and byte order explicit on any
+// compiler.  ANT+ bicycle power is little endian except page 0x20 and the
+// CTF calibration page, which are big endian.
+//------------------------------------------------------------------------------
+typedef struct {                              // 0x01 CTF zero offset
+    uchar page;                               // 0x01
+    uchar calId;                              // 0x10 CTF defined message
+    uchar ctfId;                              // 0x01 zero offset
+    uchar reserved[3];                        // 0xFF
+    uchar offsetMsb;
+    uchar offsetLsb;
+} antPage01Ctf_t;
+
+typedef struct {                              // 0x10 standard power only
+    uchar page;                               // 0x10
+    uchar event;
+    uchar pedalPower;                         // 0xFF not used
+    uchar cadence;                            // rpm, 0xFF invalid
+    uchar accPowerLsb;                        // W
+    uchar accPowerMsb;
+    uchar powerLsb;                           // W
+    uchar powerMsb;
+} antPage10_t;
+
+typedef struct {                              // 0x12 standard crank torque
+    uchar page;                               // 0x12
+    uchar event;
+    uchar revolutions;
+    uchar cadence;                            // rpm, 0xFF invalid
+    uchar accPeriodLsb;                       // 1/2048 s
+    uchar accPeriodMsb;
+    uchar accTorqueLsb;                       // 1/32 Nm
+    uchar accTorqueMsb;
+} antPage12_t;
+
+typedef struct {                              // 0x20 crank torque frequency
+    uchar page;                               // 0x20
+    uchar event;                              // revolutions
+    uchar slopeMsb;                           // 1/10 Nm/Hz
+    uchar slopeLsb;
+    uchar timeStampMsb;                       // 1/2000 s
+    uchar timeStampLsb;
+    uchar torqueTicksMsb;
+    uchar torqueTicksLsb;
+} antPage20_t;
+
+typedef struct {                              // cadence sensor 0x00, channel 1
+    uchar page;                               // 0x00
+    uchar reserved[3];                        // 0xFF
+    uchar eventTimeLsb;                       // last revolution, 1/1024 s
+    uchar eventTimeMsb;
+    uchar revolutionsLsb;                     // cumulative
+    uchar revolutionsMsb;
+} antPageCad_t;
+
+typedef struct {                              // 0x52 battery status
+    uchar page;                               // 0x52
+    uchar reserved;                           // 0xFF
+    uchar batteryId;                          // 0xFF not used
+    uchar opTime[3];                          // LSB first, 2 s units
+    uchar voltageFrac;                        // 1/256 V, 0xFF invalid
+    uchar descriptive;                        // resolution, status, coarse V
+} antPage52_t;
+
+typedef struct {                              // 0xF0 ISR profile (prof.h)
+    uchar page;                               // 0xF0
+    uchar select;                             // isr << 3 | kind << 2 | part
+    uchar value[6];                           // part 0: buckets 0-5, part 1: buckets
+                                              // 6-7, then for run time the
+                                              // vector's profMax LSB first,
+                                              // 0xFF past the last
+} antPageF0_t;
+
+typedef struct {                              // 0xF1 energy account (energy.h)
+    uchar page;                               // 0xF1
+    uchar select;                             // source << 1 | part
+    uchar value[6];                           // part 0: active, LPM0, LPM3 in
+                                              // 1/16 s, part 1: their charge in
+                                              // uC, all LSB first, rolling over
+                                              // with the part 0 times
+} antPageF1_t;
+
+typedef struct {                              // 0xF2 memory (stack.h)
+    uchar page;                               // 0xF2
+    uchar reserved;                           // 0xFF
+    uchar stackSizeLsb;                       // bytes in the stack region
+    uchar stackSizeMsb;
+    uchar stackUsedLsb;                       // high-water mark, bytes
+    uchar stackUsedMsb;
+    uchar txQueueHighWater;                   // frames
+    uchar reserved2;                          // 0xFF
+} antPageF2_t;
+
+typedef union {
+    uchar          raw[8];
+    antPage01Ctf_t cal;
+    antPage10_t    power;
+    antPage12_t    torque;
+    antPage20_t    ctf;
+    antPageCad_t   cadence;
+    antPage52_t    battery;
+    antPageF0_t    prof;
+    antPageF1_t    energy;
+    antPageF2_t    memory;
+} antPage_t;
+
+typedef char antPageSizeCheck[(sizeof(antPage_t) == 8) ? 1 : -1];
+
+extern txFrame_t txQueue[TX_QUEUE_SLOTS];
+extern volatile uint8_t txQueueHead;
+extern volatile uint8_t txQueueTail;
+extern uint8_t txFramePos;
+extern uint16_t txQueueOverflow;
+extern uint8_t txQueueHighWater;
+
+//------------------------------------------------------------------------------
+// RX: bytes from the UART receive interrupt, parsed in the main loop.
+// Same single writer scheme as the capture FIFO (srm.h).
+//------------------------------------------------------------------------------
+#define RX_FIFO_SIZE        16                // must be a power of two
+#define RX_FIFO_MASK        (RX_FIFO_SIZE - 1)
+#define RX_MSG_MAX          9                 // longest payload we keep
+
+extern volatile uchar rxFifo[RX_FIFO_SIZE];
+extern volatile uint8_t rxHead;
+extern volatile uint8_t rxTail;
+extern uint16_t rxOverflow;                   // bytes dropped, FIFO was full
+extern uint16_t rxBadFrames;                  // checksum or size errors
+
+extern uint8_t antResponseSeq;                // bumped on every command response
+extern uchar antResponseId;                   // message id it answers
+extern uchar antResponseCode;                 // RESPONSE_NO_ERROR or an error code
+extern uint16_t antTxEvents;                  // EVENT_TX seen
+#ifdef ANT_CAD_CHANNEL
+extern uint16_t antCadTxEvents;               // EVENT_TX seen on ANT_CAD_CH_ID
+#endif
+extern uint16_t antBootError;                 // last failure: frame << 8 | code
+
+//------------------------------------------------------------------------------
+// Page multiplexer: one page per channel period slot
+//------------------------------------------------------------------------------
+#define ANT_COMMON_ROUND    120               // every common page at least every n slots
+#define ANT_MAIN_EVERY      2                 // stale main page still every n slots
+#define ANT_MAIN_PAGES      4                 // main page rotation per mode, power of 2
+
+extern uint32_t antOpTime;                    // 2 s units of Timer1_A running, page 0x52
+extern uint8_t antMainSent;                   // srmDataSeq in the last main page
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+void txMessage(uchar* message,uint8_t messageSize);
+void txGather(uchar id,const uchar* head,uint8_t headSize,const uchar* body,uint8_t bodySize);
+int  txNextByte(void);
+
+void txFrame(const uchar* frame,uint8_t frameSize);
+void antBootSend(uint8_t n);
+uint8_t antBoot(void);
+void antRxDrain(void);
+void antSetPeriod(uint8_t div);
+
+void sendPower_n(void);
+void sendPower_SCT(void);
+void sendPower_CTF1(void);
+void sendPower_CTF1_CAL(void);
+void sendManufacturerInfo(void);
+void sendProductInfo(void);
+void sendBatteryStatus(void);
+void sendIsrProfile(void);
+void sendEnergyAccount(void);
+void sendMemoryStatus(void);
+void sendCadence(void);
+void antSlot(void);
+
+//------------------------------------------------------------------------------
+// Called from the UART receive ISR only
+//------------------------------------------------------------------------------
+static inline void rx_push(uchar byte)
+{
+    uint8_t head = rxHead;
+
+    if((uint8_t)(head - rxTail) >= RX_FIFO_SIZE)
+    {
+        if(rxOverflow != 0xFFFF)
+            rxOverflow++;
+        return;
+    }
+    rxFifo[head & RX_FIFO_MASK] = byte;
+    rxHead = head + 1;                        // publish after the byte is in
+}
+
+#endif // ANT_H
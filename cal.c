@@ -0,0 +1,113 @@
+//******************************************************************************
+//  cal.c - zero offset auto-calibration
+//
+//  In OFFSETMODE every kPeriod tick hands in the torque ticket heads it saw
+//  and the Timer1_A time between the first and the last of them.  The
+//  reciprocal frequency (count-1)/span is far finer than counting heads per
+//  tick, so the offset settles in a few seconds.  Mean and variance are
+//  exponentially weighted, shifts and one multiply per tick:
+//      meanAcc += x - meanAcc/8               mean = meanAcc/8
+//      varAcc  += (x-mean)^2 - varAcc/8        var  = varAcc/8
+//  Once the variance has stayed under CAL_SETTLE_VAR for CAL_SETTLE_RUN
+//  ticks the offset is frozen and written to info flash, where cal_load()
+//  finds it on the next boot.
+//******************************************************************************
+
+#include "hal.h"
+#include "cal.h"
+
+uint8_t  calState;
+uint8_t  calSamples;
+uint16_t zeroOffset;
+uint16_t ctfSlope = CAL_SLOPE_DEFAULT;
+
+uint32_t calMeanAcc;
+uint32_t calVarAcc;
+static uint8_t  calQuiet;                     // ticks in a row below CAL_SETTLE_VAR
+
+
+//------------------------------------------------------------------------------
+// Offset and slope from info flash, defaults when the segment is blank
+//------------------------------------------------------------------------------
+void cal_load(void)
+{
+    const calRecord_t *rec = (const calRecord_t *)hal_info_segment();
+
+    if(rec->magic == CAL_RECORD_MAGIC
+       && rec->check == (uint16_t)~(rec->magic ^ rec->offset ^ rec->slope))
+    {
+        zeroOffset = rec->offset;
+        ctfSlope   = rec->slope;
+    }
+}
+
+static void cal_store(void)
+{
+    calRecord_t rec;
+
+    rec.magic  = CAL_RECORD_MAGIC;
+    rec.offset = zeroOffset;
+    rec.slope  = ctfSlope;
+    rec.check  = (uint16_t)~(rec.magic ^ rec.offset ^ rec.slope);
+    hal_info_write(&rec, sizeof(rec));
+}
+
+
+//------------------------------------------------------------------------------
+// Entering OFFSETMODE: forget the last run
+//------------------------------------------------------------------------------
+void cal_start(void)
+{
+    calState   = CAL_RUNNING;
+    calSamples = 0;
+    calQuiet   = 0;
+}
+
+
+//------------------------------------------------------------------------------
+// One kPeriod tick: heads torque ticket heads, span Timer1_A ticks from the
+// first to the last one
+//------------------------------------------------------------------------------
+void cal_sample(uint16_t heads, uint16_t span)
+{
+    uint16_t x;
+    uint16_t mean;
+    uint32_t d;
+    uint32_t var;
+
+    if(calState != CAL_RUNNING || heads < 2 || span == 0)
+        return;
+
+    // (heads-1) cycles in span/4096 s, 1/16 Hz: (heads-1) * 4096 * 16 / span
+    x = (uint16_t)((((uint32_t)(heads - 1)) << 16) / span);
+
+    if(calSamples == 0)
+    {
+        calMeanAcc = (uint32_t)x << CAL_EWMA_SHIFT;
+        calVarAcc  = 0;
+    }
+    else
+    {
+        calMeanAcc += x - (calMeanAcc >> CAL_EWMA_SHIFT);    // wraps to the right value
+        mean = (uint16_t)(calMeanAcc >> CAL_EWMA_SHIFT);
+        d = x > mean ? x - mean : mean - x;
+        calVarAcc += ((d * d) >> 4) - (calVarAcc >> CAL_EWMA_SHIFT);
+    }
+    if(calSamples != 0xFF)
+        calSamples++;
+
+    mean = (uint16_t)(calMeanAcc >> CAL_EWMA_SHIFT);
+    var  = calVarAcc >> CAL_EWMA_SHIFT;
+    zeroOffset = (mean + 8) >> 4;                        // Hz, rounded
+
+    if(var <= CAL_SETTLE_VAR)
+        calQuiet++;
+    else
+        calQuiet = 0;
+
+    if(calSamples >= CAL_MIN_SAMPLES && calQuiet >= CAL_SETTLE_RUN)
+    {
+        calState = CAL_SETTLED;                          // early end, value frozen
+        cal_store();
+    }
+}
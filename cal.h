@@ -0,0 +1,46 @@
+//******************************************************************************
+//  cal.h - zero offset auto-calibration and its copy in info flash
+//******************************************************************************
+#ifndef CAL_H
+#define CAL_H
+
+#include <stdint.h>
+
+#define CAL_EWMA_SHIFT      3                 // running mean/variance over ~8 ticks
+#define CAL_MIN_SAMPLES     8                 // ~2.5 s of kPeriod ticks
+#define CAL_SETTLE_VAR      64                // (2 Hz)^2 in 1/16 Hz^2
+#define CAL_SETTLE_RUN      4                 // ticks in a row below CAL_SETTLE_VAR
+
+#define CAL_SLOPE_DEFAULT   0x01F4            // 1/10 Nm/Hz, 50.0
+#define CAL_RECORD_MAGIC    0xCA1B
+
+enum{
+    CAL_IDLE = 0,
+    CAL_RUNNING,
+    CAL_SETTLED
+};
+
+// Info flash record (segment D)
+typedef struct {
+    uint16_t magic;                           // CAL_RECORD_MAGIC
+    uint16_t offset;                          // Hz
+    uint16_t slope;                           // 1/10 Nm/Hz
+    uint16_t check;                           // ~(magic ^ offset ^ slope)
+} calRecord_t;
+
+extern uint8_t  calState;
+extern uint8_t  calSamples;
+extern uint32_t calMeanAcc;                   // 1/16 Hz << CAL_EWMA_SHIFT
+extern uint32_t calVarAcc;                    // 1/16 Hz^2 << CAL_EWMA_SHIFT
+extern uint16_t zeroOffset;                   // Hz, what page 0x01 reports; 0: not
+                                              // calibrated yet, no page 0x10/0x12
+extern uint16_t ctfSlope;                     // 1/10 Nm/Hz, what page 0x20 reports
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+void cal_load(void);
+void cal_start(void);
+void cal_sample(uint16_t heads, uint16_t span);
+
+#endif // CAL_H
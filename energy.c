@@ -0,0 +1,81 @@
+//******************************************************************************
+//  energy.c - time in active, LPM0 and LPM3 per wake-up source, and the
+//  charge it costs
+//******************************************************************************
+
+#include "hal.h"
+#include "energy.h"
+
+#ifndef ISR_PROFILE
+
+uint16_t energyTime[ENERGY_SOURCES][ENERGY_STATES];
+uint8_t  energyCarry[ENERGY_SOURCES][ENERGY_STATES];
+volatile uint8_t energyWake = ENERGY_SRC_NONE;
+
+static uint16_t energyMark;                   // Timer1 count at the last sleep or wake
+static uint8_t energyActive = ENERGY_SRC_TIMER1;  // source the CPU is awake for
+
+static const uint16_t energyCurrent[ENERGY_STATES] = {
+    ENERGY_UA8_ACTIVE, ENERGY_UA8_LPM0, ENERGY_UA8_LPM3
+};
+
+// Ticks since the last mark, mark moved on.  Sleeps end on the 250 ms
+// channel slot at the latest, far inside the 16 s Timer1 wrap.
+static uint16_t energy_lap(void)
+{
+    uint16_t now = hal_timer1_now();
+    uint16_t lap = now - energyMark;
+
+    energyMark = now;
+    return lap;
+}
+
+// lap Timer1 ticks (4096 Hz) onto a 1/16 s counter and its carry
+static void energy_add(uint8_t src, uint8_t state, uint16_t lap)
+{
+    uint16_t carry = energyCarry[src][state] + (lap & 0xFF);
+
+    energyTime[src][state] += (lap >> 8) + (carry >> 8);
+    energyCarry[src][state] = (uint8_t)carry;
+}
+
+void energy_start(void)
+{
+    energyMark = hal_timer1_now();
+}
+
+void energy_sleep(void)
+{
+    energy_add(energyActive, ENERGY_ACTIVE, energy_lap());
+    energyWake = ENERGY_SRC_NONE;
+}
+
+void energy_wake(uint8_t state)
+{
+    uint8_t src = energyWake;
+
+    if(src != ENERGY_SRC_NONE)
+        energyActive = src;
+    energy_add(energyActive, state, energy_lap());
+}
+
+//------------------------------------------------------------------------------
+// 1/16 s * current in 1/8 uA / (16 * 8) = uC, plus the carry ticks
+// (/ (4096 * 8)).  65535 * 19200 stays inside 32 bits.
+//------------------------------------------------------------------------------
+uint32_t energy_charge(uint8_t src)
+{
+    uint32_t charge = 0;
+    uint8_t state;
+
+    for(state = 0; state < ENERGY_STATES; state++)
+    {
+        uint16_t i = energyCurrent[state];
+
+        charge += ((uint32_t)energyTime[src][state] * i) >> 7;
+        charge += ((uint32_t)energyCarry[src][state] * i) >> 15;
+    }
+    return charge;
+}
+
+#endif // ISR_PROFILE
@@ -0,0 +1,83 @@
+//******************************************************************************
+//  energy.h - time in active, LPM0 and LPM3 per wake-up source, and the
+//  charge it costs
+//
+//  The main loop marks every sleep and wake with the free running Timer1_A
+//  count (ACLK/8, the one clock that keeps running in LPM3).  The vector
+//  that ends a sleep names itself with energy_source(); the sleep and the
+//  active stretch that follows are charged to it.  Interrupts serviced
+//  without waking the main loop count as part of the sleep around them.
+//  Stretches are mostly shorter than a Timer1 tick (244 us), but the tick
+//  phase is random against them, so the sums are unbiased.
+//  An LPM4 sleep (lpm.h) stops Timer1_A with ACLK and is filed under LPM3,
+//  where it adds next to nothing, as its current does.
+//
+//  Charge uses datasheet typicals for the MSP430G2553 at 3 V (MCU only,
+//  not the ANT module): active at the 8 MHz the main loop works at, the
+//  sleeps at the 1 MHz DCO it drops back to (clock manager, main file).
+//
+//  The ISR_PROFILE build leaves the account out: its 41 bytes of RAM go to
+//  the ISR histograms (prof.h), and its page 0xF1 to theirs.  Every call
+//  below is then empty.
+//******************************************************************************
+#ifndef ENERGY_H
+#define ENERGY_H
+
+#include <stdint.h>
+#include "prof.h"
+
+#define ENERGY_UA8_ACTIVE   (2400 * 8)        // 1/8 uA, active mode, 8 MHz
+#define ENERGY_UA8_LPM0     (83 * 8)          // LPM0, SMCLK on for the UART
+#define ENERGY_UA8_LPM3     7                 // LPM3, 32 kHz crystal, 0.9 uA
+
+enum{
+    ENERGY_SRC_PORT1 = 0,                     // P1.3 mode switch
+    ENERGY_SRC_PORT2,                         // P2.2 torque edge (Timer1_A CCR1)
+    ENERGY_SRC_TIMER0,                        // ANT link UART
+    ENERGY_SRC_TIMER1,                        // channel slot, OFFSETMODE tick
+    ENERGY_SOURCES,
+    ENERGY_SRC_NONE = ENERGY_SOURCES
+};
+
+enum{
+    ENERGY_ACTIVE = 0,
+    ENERGY_LPM0,
+    ENERGY_LPM3,
+    ENERGY_STATES
+};
+
+#ifndef ISR_PROFILE
+
+// 16 bit counters in 1/16 s, rolling over after 4096 s, each with a carry
+// byte of the Timer1 ticks not yet worth 1/16 s: 36 bytes of RAM.
+extern uint16_t energyTime[ENERGY_SOURCES][ENERGY_STATES];    // 1/16 s
+extern uint8_t  energyCarry[ENERGY_SOURCES][ENERGY_STATES];   // Timer1 ticks
+extern volatile uint8_t energyWake;           // vector that ended the sleep
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+void energy_start(void);                      // main loop entry
+void energy_sleep(void);                      // interrupts off, about to sleep
+void energy_wake(uint8_t state);              // back from LPM0 or LPM3
+uint32_t energy_charge(uint8_t src);          // uC of the energyTime[src] counts
+
+//------------------------------------------------------------------------------
+// Called from the vectors, next to __bic_SR_register_on_exit()
+//------------------------------------------------------------------------------
+static inline void energy_source(uint8_t src)
+{
+    if(energyWake == ENERGY_SRC_NONE)
+        energyWake = src;
+}
+
+#else
+
+#define energy_start()
+#define energy_sleep()
+#define energy_wake(state)
+#define energy_source(src)
+
+#endif // ISR_PROFILE
+
+#endif // ENERGY_H
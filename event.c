@@ -0,0 +1,58 @@
+//******************************************************************************
+//  event.c - deferred work dispatch for the main loop
+//******************************************************************************
+
+#include "hal.h"
+#include "event.h"
+#include "ant.h"
+#include "srm.h"
+#include "power.h"
+#include "log.h"
+#include "lpm.h"
+
+volatile uint8_t eventFlags;
+
+static const struct {
+    uint8_t ev;
+    void (*run)(void);
+} eventTable[] = {
+    { EV_CAPTURE,   srm_capture_drain },    // decode first, slots send the result
+    { EV_MODE,      srm_mode_change   },
+    { EV_CAL_TICK,  srm_cal_tick      },
+    { EV_SLOT,      power_slot        },    // averages before the page goes out
+    { EV_SLOT,      log_slot          },    // erase with the UART still idle
+    { EV_SLOT,      antSlot           },
+    { EV_SLOT,      lpm_slot          },    // sets the distance to the next slot
+    { EV_RX,        antRxDrain        },
+};
+
+#define EVENT_TABLE_SIZE    (sizeof(eventTable) / sizeof(eventTable[0]))
+
+uint8_t event_take(void)
+{
+    hal_istate_t state = hal_irq_save();
+    uint8_t ev = eventFlags;
+
+    eventFlags = 0;
+    hal_irq_restore(state);
+    return ev;
+}
+
+void event_dispatch(uint8_t ev)
+{
+    uint8_t i;
+
+    for(i = 0; i < EVENT_TABLE_SIZE; i++)
+    {
+        if(ev & eventTable[i].ev)
+            eventTable[i].run();
+    }
+}
+
+void event_run(void)
+{
+    uint8_t ev;
+
+    while((ev = event_take()) != 0)
+        event_dispatch(ev);
+}
@@ -0,0 +1,39 @@
+//******************************************************************************
+//  event.h - deferred work posted by the interrupt vectors
+//
+//  The vectors only latch hardware state (capture FIFO, timer compares,
+//  flags) and post an event bit; the main loop takes all pending bits at
+//  once, runs their handlers and goes back to sleep.  A new processing
+//  stage is one EV_ bit and one line in eventTable[] (event.c).
+//******************************************************************************
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+
+// Handlers run in bit order, lowest first, several per bit in table order
+#define EV_CAPTURE  0x01                    // TIMER1_A1 CCR1: torque edges in captureFifo
+#define EV_MODE     0x02                    // Port_1 P1.3: mode switch pressed
+#define EV_CAL_TICK 0x04                    // TIMER1_A0: OFFSETMODE tick
+#define EV_SLOT     0x08                    // TIMER1_A1 CCR2: ANT channel period slot
+#define EV_RX       0x10                    // UART RX: bytes from the module in rxFifo
+
+extern volatile uint8_t eventFlags;
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+uint8_t event_take(void);                   // fetch and clear all pending bits
+void event_dispatch(uint8_t ev);            // run the handlers for ev
+void event_run(void);                       // take and dispatch until idle
+
+//------------------------------------------------------------------------------
+// Called from interrupt vectors only.  Vectors do not nest, and a read-
+// modify-write of a byte is one BIS.B, so no locking is needed here.
+//------------------------------------------------------------------------------
+static inline void event_post(uint8_t ev)
+{
+    eventFlags |= ev;
+}
+
+#endif // EVENT_H
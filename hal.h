@@ -0,0 +1,154 @@
+//******************************************************************************
+//  hal.h - thin hardware access layer
+//
+//  The decoder (srm.c) and the ANT framing (ant.c) only touch hardware
+//  through the names below.  On the MSP430 they are static inline register
+//  accessors, so each one compiles to the same one or two instructions as
+//  the open-coded register access it replaces.  Building with HOST_SIM
+//  defined maps the same names onto the peripheral models in host/sim.c.
+//******************************************************************************
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// ANT link UART on P1.1/P1.2, SMCLK = 1MHz.  The default is the Timer_A
+// bit-banged UART (one interrupt per bit, 4800 or 9600 baud).  Define
+// UART_USCI_A0 for the USCI_A0 hardware UART (one interrupt per byte,
+// 19200..57600 baud), which leaves Timer_A stopped.  UART_BAUD must match
+// the AP1 baud rate strapping.
+//------------------------------------------------------------------------------
+//#define UART_USCI_A0
+
+#ifndef UART_BAUD
+#ifdef UART_USCI_A0
+#define UART_BAUD           57600UL
+#else
+#define UART_BAUD           4800UL
+#endif
+#endif
+
+#ifdef UART_USCI_A0
+#if UART_BAUD < 19200 || UART_BAUD > 57600
+#error "USCI_A0 ANT link: UART_BAUD must be 19200..57600"
+#endif
+#define UART_tx_start       USCI_A0_UART_tx_start
+#define UART_tx_wait        USCI_A0_UART_tx_wait
+#else
+#if UART_BAUD > 9600
+#error "Timer_A UART cannot keep up above 9600 baud on a 1MHz SMCLK"
+#endif
+#define UART_tx_start       TimerA_UART_tx_start
+#define UART_tx_wait        TimerA_UART_tx_wait
+#endif
+
+#ifdef HOST_SIM
+
+#include "host/sim.h"
+
+#else
+
+#include "msp430g2553.h"
+
+typedef unsigned short hal_istate_t;
+
+//------------------------------------------------------------------------------
+// Interrupt state: save+disable / restore, nests safely inside ISRs
+//------------------------------------------------------------------------------
+static inline hal_istate_t hal_irq_save(void)
+{
+    hal_istate_t state = __get_interrupt_state();
+    __disable_interrupt();
+    return state;
+}
+
+static inline void hal_irq_restore(hal_istate_t state)
+{
+    __set_interrupt_state(state);
+}
+
+//------------------------------------------------------------------------------
+// LEDs: P1.0 mode, P1.6 cadence
+//------------------------------------------------------------------------------
+static inline void hal_led_mode_off(void)       { P1OUT &= ~BIT0; }
+static inline void hal_led_mode_toggle(void)    { P1OUT ^= BIT0; }
+static inline void hal_led_cadence_off(void)    { P1OUT &= ~BIT6; }
+static inline void hal_led_cadence_toggle(void) { P1OUT ^= BIT6; }
+
+//------------------------------------------------------------------------------
+// Busy wait, startup code only (MCLK = 1MHz)
+//------------------------------------------------------------------------------
+static inline void hal_delay_100us(void)        { __delay_cycles(100); }
+
+//------------------------------------------------------------------------------
+// Free running 1us count for the ISR profile (prof.h): Timer_A on SMCLK
+//------------------------------------------------------------------------------
+static inline uint16_t hal_prof_now(void)       { return TAR; }
+
+//------------------------------------------------------------------------------
+// Timer1_A count (ACLK/8, runs in LPM3).  ACLK is asynchronous to MCLK, so
+// read until two reads agree.
+//------------------------------------------------------------------------------
+static inline uint16_t hal_timer1_now(void)
+{
+    uint16_t t;
+
+    do
+        t = TA1R;
+    while (t != TA1R);
+    return t;
+}
+
+//------------------------------------------------------------------------------
+// Info flash segment D (0x1000, 64 bytes), memory mapped for reading
+//------------------------------------------------------------------------------
+#define HAL_INFO_SEG_D      0x1000
+#define HAL_INFO_SEG_SIZE   64
+
+static inline const void *hal_info_segment(void) { return (const void *)HAL_INFO_SEG_D; }
+
+//------------------------------------------------------------------------------
+// Main flash kept for the ride log (log.h), memory mapped for reading.  The
+// linker command file must keep code and constants out of it: FLASH from
+// 0xD000 instead of 0xC000 in lnk_msp430g2553.cmd (CCS) or the CODE/CONST
+// ranges in lnk430g2553.xcl (IAR).
+//------------------------------------------------------------------------------
+#define HAL_LOG_BASE        0xC000
+#define HAL_LOG_SIZE        4096              // 8 segments of 512 bytes
+
+static inline const uint8_t *hal_log_flash(void) { return (const uint8_t *)HAL_LOG_BASE; }
+
+//------------------------------------------------------------------------------
+// Stack region the linker reserves (stack.h): CSTACK on IAR, .stack on CCS
+// (size set by --stack_size, __STACK_SIZE).  The stack grows down from the
+// high end.
+//------------------------------------------------------------------------------
+#ifdef __IAR_SYSTEMS_ICC__
+#pragma segment="CSTACK"
+static inline uint8_t *hal_stack_low(void)      { return (uint8_t *)__segment_begin("CSTACK"); }
+static inline uint8_t *hal_stack_high(void)     { return (uint8_t *)__segment_end("CSTACK"); }
+#else
+extern char _stack;                         // lowest address of .stack
+extern char __STACK_END;                    // one past the highest
+static inline uint8_t *hal_stack_low(void)      { return (uint8_t *)&_stack; }
+static inline uint8_t *hal_stack_high(void)     { return (uint8_t *)&__STACK_END; }
+#endif
+static inline uint8_t *hal_stack_pointer(void)  { return (uint8_t *)(uintptr_t)__get_SP_register(); }
+
+#endif // HOST_SIM
+
+//------------------------------------------------------------------------------
+// Provided by the main file on target, by host/sim.c on the host
+//------------------------------------------------------------------------------
+void UART_tx_start(void);                   // kick the UART if it is idle
+void UART_tx_wait(void);                    // every queued frame on the line, startup only
+void Timer1_A_period_init(void);            // Timer1_A free running (CTMMODE)
+void Timer1_A_period_CAL_init(void);        // Timer1_A kPeriod tick (OFFSETMODE)
+void Timer1_A_slot_sync(void);              // slots ANT_SYNC_TICKS after now, period apart
+void hal_info_write(const void *data, uint8_t size);    // erase segment D, program it
+void hal_log_erase(uint16_t at);            // ride log segment at this offset
+void hal_log_write(uint16_t at, const uint8_t *data, uint8_t size);
+uint32_t hal_timer1_now32(void);            // Timer1_A count extended by its wraps
+
+#endif // HAL_H
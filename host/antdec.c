@@ -0,0 +1,254 @@
+//******************************************************************************
+//  host/antdec.c - decoder for the converter's ANT serial stream
+//
+//  Framing is parsed one byte at a time like antRxByte() does on the target,
+//  but a bad size or checksum does not throw the bytes away: everything
+//  after the false sync byte is parsed again, so a real frame that started
+//  inside a corrupt one is still found.
+//
+//  Pages are read the way an ANT+ head unit reads them, from the deltas to
+//  the previous page of the same kind (event count, accumulated period or
+//  time stamp, accumulated torque or torque ticks), so a dropped page only
+//  stretches the interval instead of giving a wrong value.
+//******************************************************************************
+
+#include <math.h>
+#include <string.h>
+
+#include "ant.h"
+#include "antdec.h"
+
+#ifndef M_PI
+#define M_PI        3.14159265358979323846
+#endif
+
+#define U16LE(p)    ((uint16_t)((p)[0] | (p)[1] << 8))
+#define U16BE(p)    ((uint16_t)((p)[0] << 8 | (p)[1]))
+
+void antdec_init(antdec_t *d)
+{
+    int i;
+
+    memset(d, 0, sizeof(*d));
+    for (i = 0; i < ANTDEC_CHANNELS; i++) {
+        d->ch[i].cadence = -1.0;
+        d->ch[i].torque = -1.0;
+        d->ch[i].power = -1.0;
+        d->ch[i].source = -1;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Page kinds
+//------------------------------------------------------------------------------
+static int page_kind(uint8_t channel, const uint8_t *p)
+{
+    if (channel == ANT_CAD_CH_ID)
+        return (p[0] & 0x7F) == 0x00 ? ANTDEC_PCAD : ANTDEC_POTHER;
+    switch (p[0]) {
+    case 0x01: return (p[1] == 0x10 && p[2] == 0x01) ? ANTDEC_P01 : ANTDEC_POTHER;
+    case 0x10: return ANTDEC_P10;
+    case 0x12: return ANTDEC_P12;
+    case 0x20: return ANTDEC_P20;
+    default:   return ANTDEC_POTHER;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Head unit math, p = this page, l = the previous one of the kind.
+// Returns 1 when the event count moved on and the values are new.
+//------------------------------------------------------------------------------
+static int page10(antdec_chan_t *c, const uint8_t *p, const uint8_t *l)
+{
+    uint8_t events = p[1] - l[1];
+    uint16_t acc = U16LE(&p[4]) - U16LE(&l[4]);
+
+    if (events == 0)
+        return 0;
+    c->power = (double)acc / events;                // average over the events
+    c->cadence = p[3] == 0xFF ? -1.0 : p[3];
+    return 1;
+}
+
+static int page12(antdec_chan_t *c, const uint8_t *p, const uint8_t *l)
+{
+    uint8_t events = p[1] - l[1];
+    uint8_t revs = p[2] - l[2];
+    uint16_t period = U16LE(&p[4]) - U16LE(&l[4]);  // 1/2048 s
+    uint16_t torque = U16LE(&p[6]) - U16LE(&l[6]);  // 1/32 Nm
+
+    if (events == 0 || period == 0)
+        return 0;
+    c->cadence = 60.0 * 2048.0 * revs / period;
+    c->torque = torque / (32.0 * events);
+    c->power = 128.0 * M_PI * torque / period;
+    return 1;
+}
+
+static int page20(antdec_chan_t *c, const uint8_t *p, const uint8_t *l)
+{
+    uint8_t events = p[1] - l[1];
+    uint16_t slope = U16BE(&p[2]);                  // 1/10 Nm/Hz
+    uint16_t time = U16BE(&p[4]) - U16BE(&l[4]);    // 1/2000 s
+    uint16_t ticks = U16BE(&p[6]) - U16BE(&l[6]);
+    double elapsed, hz;
+
+    if (events == 0 || time == 0)
+        return 0;
+    elapsed = time / 2000.0;
+    c->cadence = 60.0 * events / elapsed;
+    if (slope == 0)
+        return 1;
+    hz = ticks / elapsed - (c->haveOffset ? c->offset : 0);
+    c->torque = hz * 10.0 / slope;
+    c->power = c->torque * c->cadence * M_PI / 30.0;
+    return 1;
+}
+
+static int page_cad(antdec_chan_t *c, const uint8_t *p, const uint8_t *l)
+{
+    uint16_t time = U16LE(&p[4]) - U16LE(&l[4]);    // 1/1024 s
+    uint16_t revs = U16LE(&p[6]) - U16LE(&l[6]);
+
+    if (time == 0)
+        return 0;
+    c->cadence = 60.0 * 1024.0 * revs / time;
+    return 1;
+}
+
+static void page(antdec_t *d, uint8_t channel, const uint8_t *p)
+{
+    antdec_chan_t *c;
+    int kind = page_kind(channel, p);
+    int fresh = 0;
+
+    d->pages[kind]++;
+    if (channel >= ANTDEC_CHANNELS || kind == ANTDEC_POTHER)
+        return;
+    c = &d->ch[channel];
+
+    if (kind == ANTDEC_P01) {
+        c->offset = U16BE(&p[6]);
+        c->haveOffset = 1;
+    }
+    else if (c->seen[kind]) {
+        const uint8_t *l = c->last[kind];
+
+        switch (kind) {
+        case ANTDEC_P10:  fresh = page10(c, p, l);   break;
+        case ANTDEC_P12:  fresh = page12(c, p, l);   break;
+        case ANTDEC_P20:  fresh = page20(c, p, l);   break;
+        case ANTDEC_PCAD: fresh = page_cad(c, p, l); break;
+        }
+    }
+    if (fresh) {
+        c->source = kind;
+        c->updates++;
+    }
+    memcpy(c->last[kind], p, 8);
+    c->seen[kind] = 1;
+}
+
+//------------------------------------------------------------------------------
+// Framing
+//------------------------------------------------------------------------------
+static void frame(antdec_t *d, double t, antdec_frame_cb cb, void *arg)
+{
+    uint8_t size = d->raw[1];
+    uint8_t id = d->raw[2];
+    const uint8_t *data = &d->raw[3];
+    double gap;
+
+    if (d->frames == 0)
+        d->firstAt = t;
+    else {
+        gap = t - d->lastAt;
+        if (gap > d->gapMax)
+            d->gapMax = gap;
+        if (d->gapLimit > 0 && gap > d->gapLimit)
+            d->gapsOver++;
+    }
+    d->lastAt = t;
+    d->frames++;
+
+    if (id == MESG_BROADCAST_DATA_ID && size == 9)
+        page(d, data[0], &data[1]);
+    if (cb)
+        cb(d, id, data, size, t, arg);
+}
+
+static void byte(antdec_t *d, uint8_t b, double t, antdec_frame_cb cb, void *arg);
+
+// Drop the false sync byte and parse what followed it again
+static void resync(antdec_t *d, double t, antdec_frame_cb cb, void *arg)
+{
+    uint8_t again[sizeof(d->raw)];
+    uint8_t n = d->pos - 1;
+    uint8_t i;
+
+    memcpy(again, &d->raw[1], n);
+    d->pos = 0;
+    d->skipped++;
+    for (i = 0; i < n; i++)
+        byte(d, again[i], t, cb, arg);
+}
+
+static void byte(antdec_t *d, uint8_t b, double t, antdec_frame_cb cb, void *arg)
+{
+    uint8_t sum;
+    uint8_t i;
+
+    if (d->pos == 0) {
+        if (b == ANT_SYNC)
+            d->raw[d->pos++] = b;
+        else
+            d->skipped++;
+        return;
+    }
+
+    d->raw[d->pos++] = b;
+    if (d->pos == 2 && (b == 0 || b > ANTDEC_MSG_MAX)) {
+        d->badSize++;
+        resync(d, t, cb, arg);
+        return;
+    }
+    if (d->pos < 2 || d->pos < d->raw[1] + 4)
+        return;
+
+    for (sum = 0, i = 0; i < d->pos - 1; i++)
+        sum ^= d->raw[i];
+    if (sum != b) {
+        d->badSum++;
+        resync(d, t, cb, arg);
+        return;
+    }
+    frame(d, t, cb, arg);
+    d->pos = 0;
+}
+
+void antdec_feed(antdec_t *d, const uint8_t *buf, int n, double t,
+                 antdec_frame_cb cb, void *arg)
+{
+    int i;
+
+    d->bytes += n;
+    for (i = 0; i < n; i++)
+        byte(d, buf[i], t, cb, arg);
+}
+
+//------------------------------------------------------------------------------
+// Statistics
+//------------------------------------------------------------------------------
+double antdec_rate(const antdec_t *d)
+{
+    if (d->frames < 2 || d->lastAt <= d->firstAt)
+        return 0.0;
+    return (d->frames - 1) / (d->lastAt - d->firstAt);
+}
+
+double antdec_gap_mean(const antdec_t *d)
+{
+    if (d->frames < 2)
+        return 0.0;
+    return (d->lastAt - d->firstAt) / (d->frames - 1);
+}
@@ -0,0 +1,78 @@
+//******************************************************************************
+//  host/antdec.h - decoder for the converter's ANT serial stream
+//
+//  Takes the bytes the MSP430 sends the AP1 (txGather()/txFrame() framing:
+//  sync 0xA4, size, id, data, XOR checksum), one stream per converter, and
+//  turns the power pages into the cadence, torque and power a head unit
+//  would show.  No I/O: the caller feeds bytes with their arrival time, so
+//  the same code serves the gateway daemon (antgw.c) and offline tools.
+//******************************************************************************
+#ifndef ANTDEC_H
+#define ANTDEC_H
+
+#include <stdint.h>
+
+#define ANTDEC_MSG_MAX      9                   // longest payload in a frame
+#define ANTDEC_CHANNELS     2                   // power, cadence (ANT_CAD_CHANNEL)
+
+enum {
+    ANTDEC_P01 = 0,                             // CTF zero offset
+    ANTDEC_P10,                                 // standard power only
+    ANTDEC_P12,                                 // standard crank torque
+    ANTDEC_P20,                                 // crank torque frequency
+    ANTDEC_PCAD,                                // cadence sensor page 0
+    ANTDEC_POTHER,                              // common, debug, unknown
+    ANTDEC_PAGES
+};
+
+// Head unit view of one channel: the last page of each kind and the values
+// the deltas to it gave
+typedef struct {
+    int      seen[ANTDEC_PAGES];                // previous page of the kind valid
+    uint8_t  last[ANTDEC_PAGES][8];             // previous page of the kind
+
+    double   cadence;                           // rpm, < 0 not known yet
+    double   torque;                            // Nm, < 0 not known yet
+    double   power;                             // W, < 0 not known yet
+    int      source;                            // ANTDEC_P.. that set them last
+    uint32_t updates;                           // new values (events moved on)
+
+    uint16_t offset;                            // CTF zero offset, Hz (page 0x01)
+    int      haveOffset;
+} antdec_chan_t;
+
+typedef struct {
+    // framing
+    uint8_t  raw[ANTDEC_MSG_MAX + 4];           // frame so far, sync included
+    uint8_t  pos;                               // 0 = hunting for sync
+
+    // statistics
+    uint64_t bytes;
+    uint32_t frames;                            // good checksum
+    uint32_t badSum;                            // checksum errors
+    uint32_t badSize;                           // size field out of range
+    uint64_t skipped;                           // bytes dropped hunting for sync
+    uint32_t pages[ANTDEC_PAGES];
+    double   firstAt;                           // time of the first good frame, s
+    double   lastAt;                            // and of the last one
+    double   gapMax;                            // longest time between good frames
+    uint32_t gapsOver;                          // gaps over gapLimit
+    double   gapLimit;                          // set by the caller, 0 = off
+
+    antdec_chan_t ch[ANTDEC_CHANNELS];
+} antdec_t;
+
+// Called for every good frame, after the page (if any) was decoded
+typedef void (*antdec_frame_cb)(antdec_t *d, uint8_t id, const uint8_t *data,
+                                uint8_t size, double t, void *arg);
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+void   antdec_init(antdec_t *d);
+void   antdec_feed(antdec_t *d, const uint8_t *buf, int n, double t,
+                   antdec_frame_cb cb, void *arg);
+double antdec_rate(const antdec_t *d);          // good frames per second
+double antdec_gap_mean(const antdec_t *d);      // s
+
+#endif // ANTDEC_H
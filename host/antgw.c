@@ -0,0 +1,271 @@
+//******************************************************************************
+//  host/antgw.c - bench gateway: decode the ANT serial line of many
+//  converters at once
+//
+//  Each argument is a tty (a USB serial adapter on a converter's TX line,
+//  or the slave side of a pty from antreplay) and becomes one stream with
+//  its own antdec_t.  One poll() loop reads every stream as bytes arrive, so
+//  hundreds of units on one bench cost one thread and a few us per frame.
+//
+//  usage: antgw [-b baud] [-i seconds] [-o stats.txt] [-g gap_ms] [-v] tty...
+//         -b  line rate for real serial ports (4800)
+//         -i  print per-stream statistics every n seconds (10, 0 = at exit)
+//         -o  also write them to a file, replaced atomically each time
+//         -g  count gaps between good frames longer than this (300 ms)
+//         -v  print every decoded page with the values it gave
+//
+//  SIGUSR1 prints the statistics now, SIGINT/SIGTERM prints them and exits.
+//  A stream whose tty goes away (EOF, EIO on a closed pty) is closed and
+//  keeps its final statistics.
+//******************************************************************************
+
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "ant.h"
+#include "antdec.h"
+
+#define GW_READ_CHUNK       4096
+
+typedef struct {
+    const char *name;
+    int         fd;                             // -1 once closed
+    antdec_t    dec;
+} stream_t;
+
+static stream_t *stream;
+static int streams;
+static int verbose;
+
+static volatile sig_atomic_t stop;
+static volatile sig_atomic_t dump;
+
+static const char *kindName[ANTDEC_PAGES] = {
+    "01", "10", "12", "20", "cad", "other"
+};
+
+static void on_signal(int sig)
+{
+    if (sig == SIGUSR1)
+        dump = 1;
+    else
+        stop = 1;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static speed_t baud_code(long baud)
+{
+    switch (baud) {
+    case 4800:   return B4800;
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 115200: return B115200;
+    default:     return 0;
+    }
+}
+
+// Raw 8N1, no echo, no flow control; a pty takes it too
+static int open_tty(const char *path, speed_t speed)
+{
+    struct termios tio;
+    int fd = open(path, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+
+    if (fd < 0)
+        return -1;
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        tio.c_cflag |= CLOCAL | CREAD;
+        tio.c_cflag &= ~CRTSCTS;
+        cfsetispeed(&tio, speed);
+        cfsetospeed(&tio, speed);
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    return fd;
+}
+
+//------------------------------------------------------------------------------
+// Output
+//------------------------------------------------------------------------------
+static void on_frame(antdec_t *d, uint8_t id, const uint8_t *data, uint8_t size,
+                     double t, void *arg)
+{
+    const stream_t *s = arg;
+    const antdec_chan_t *c;
+
+    if (!verbose || id != MESG_BROADCAST_DATA_ID || size != 9
+        || data[0] >= ANTDEC_CHANNELS)
+        return;
+    c = &d->ch[data[0]];
+    printf("%.3f %s ch%u page %02X  cadence %.1f  torque %.2f  power %.1f\n",
+           t, s->name, data[0], data[1], c->cadence, c->torque, c->power);
+}
+
+static void stats_write(FILE *f)
+{
+    int i, k, n;
+
+    for (i = 0; i < streams; i++) {
+        const antdec_t *d = &stream[i].dec;
+        const antdec_chan_t *c = &d->ch[0];
+
+        fprintf(f, "%s %s frames=%u rate=%.3f gap_mean_ms=%.1f gap_max_ms=%.1f"
+                " gaps_over=%u bad_sum=%u bad_size=%u skipped=%llu",
+                stream[i].name, stream[i].fd < 0 ? "closed" : "open",
+                d->frames, antdec_rate(d), antdec_gap_mean(d) * 1e3,
+                d->gapMax * 1e3, d->gapsOver, d->badSum, d->badSize,
+                (unsigned long long)d->skipped);
+        for (k = 0; k < ANTDEC_PAGES; k++)
+            fprintf(f, " p%s=%u", kindName[k], d->pages[k]);
+        fprintf(f, " cadence=%.1f torque=%.2f power=%.1f",
+                c->cadence, c->torque, c->power);
+        for (n = 1; n < ANTDEC_CHANNELS; n++)
+            if (d->ch[n].updates)
+                fprintf(f, " ch%d_cadence=%.1f", n, d->ch[n].cadence);
+        fprintf(f, "\n");
+    }
+    fflush(f);
+}
+
+static void stats_dump(const char *path)
+{
+    char tmp[4096];
+    FILE *f;
+
+    stats_write(stdout);
+    if (!path)
+        return;
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    f = fopen(tmp, "w");
+    if (!f) {
+        perror(tmp);
+        return;
+    }
+    stats_write(f);
+    fclose(f);
+    if (rename(tmp, path) != 0)
+        perror(path);
+}
+
+//------------------------------------------------------------------------------
+// Event loop
+//------------------------------------------------------------------------------
+int main(int argc, char **argv)
+{
+    long baud = 4800;
+    double interval = 10.0, gap = 0.3, next;
+    const char *out = NULL;
+    struct pollfd *pfd;
+    struct sigaction sa;
+    uint8_t buf[GW_READ_CHUNK];
+    speed_t speed;
+    int i, open_streams;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-b") && i + 1 < argc)       baud = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-i") && i + 1 < argc)  interval = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-o") && i + 1 < argc)  out = argv[++i];
+        else if (!strcmp(argv[i], "-g") && i + 1 < argc)  gap = atof(argv[++i]) / 1e3;
+        else if (!strcmp(argv[i], "-v"))                  verbose = 1;
+        else
+            break;
+    }
+    speed = baud_code(baud);
+    if (i >= argc || speed == 0) {
+        fprintf(stderr, "usage: %s [-b baud] [-i seconds] [-o stats.txt] [-g gap_ms] [-v] tty...\n", argv[0]);
+        return 2;
+    }
+
+    streams = argc - i;
+    stream = calloc(streams, sizeof(*stream));
+    pfd = calloc(streams, sizeof(*pfd));
+    if (!stream || !pfd) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (open_streams = 0; i < argc; i++) {
+        stream_t *s = &stream[open_streams++];
+
+        s->name = argv[i];
+        antdec_init(&s->dec);
+        s->dec.gapLimit = gap;
+        s->fd = open_tty(s->name, speed);
+        if (s->fd < 0)
+            perror(s->name);
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+    sigaction(SIGUSR1, &sa, NULL);
+
+    next = now_sec() + interval;
+    while (!stop) {
+        double t;
+        int timeout = -1;
+
+        for (i = 0, open_streams = 0; i < streams; i++) {
+            pfd[i].fd = stream[i].fd;           // negative: poll() skips it
+            pfd[i].events = POLLIN;
+            pfd[i].revents = 0;
+            if (stream[i].fd >= 0)
+                open_streams++;
+        }
+        if (open_streams == 0)
+            break;
+        if (interval > 0) {
+            t = next - now_sec();
+            timeout = t > 0 ? (int)(t * 1e3) + 1 : 0;
+        }
+
+        if (poll(pfd, streams, timeout) < 0 && errno != EINTR) {
+            perror("poll");
+            break;
+        }
+        t = now_sec();
+
+        for (i = 0; i < streams; i++) {
+            stream_t *s = &stream[i];
+            ssize_t n;
+
+            if (!(pfd[i].revents & (POLLIN | POLLHUP | POLLERR)))
+                continue;
+            n = read(s->fd, buf, sizeof(buf));
+            if (n > 0)
+                antdec_feed(&s->dec, buf, (int)n, t, on_frame, s);
+            else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+                close(s->fd);                   // EOF, or EIO: pty master gone
+                s->fd = -1;
+            }
+        }
+
+        if (dump || (interval > 0 && t >= next)) {
+            stats_dump(out);
+            dump = 0;
+            if (interval > 0)
+                next = t + interval;
+        }
+    }
+
+    stats_dump(out);
+    return 0;
+}
@@ -0,0 +1,219 @@
+//******************************************************************************
+//  host/antreplay.c - replay a captured ANT serial stream into pty pairs
+//
+//  Opens n pseudo-terminals, prints the slave side names one per line (hand
+//  them to antgw), waits for the reader to attach, then writes the capture
+//  into every master at the pace it was recorded.  Exits, and so hangs up
+//  the ptys, when the capture has played out.
+//
+//  Capture formats:
+//      text    one frame per line, time first, as the sim frame dump
+//              ("611.781 ms  A4 09 4E ...", ms) or bench_replay -d
+//              ("611781 A4 09 4E ...", us) write them
+//      raw     (-r) the bytes as a logic analyser or serial capture saved
+//              them, paced at the line rate
+//
+//  usage: antreplay [-n ptys] [-r] [-b baud] [-x speed] [-e n] [-w seconds]
+//                   [-l loops] capture
+//         -n  streams to open (1)
+//         -r  raw binary capture
+//         -b  line rate for raw captures (4800)
+//         -x  time scale, 2 = twice as fast, 0 = as fast as the ptys take it
+//         -e  corrupt one byte in about every n per stream, to exercise resync
+//         -w  seconds to wait after printing the names (1)
+//         -l  play the capture this many times (1)
+//******************************************************************************
+
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+typedef struct {
+    double  t;                                  // s from the start of the capture
+    int     len;
+    uint8_t data[16];
+} chunk_t;
+
+static chunk_t *chunk;
+static size_t chunks, chunkCap;
+
+static chunk_t *chunk_add(void)
+{
+    if (chunks == chunkCap) {
+        chunkCap = chunkCap ? chunkCap * 2 : 4096;
+        chunk = realloc(chunk, chunkCap * sizeof(*chunk));
+        if (!chunk) {
+            fprintf(stderr, "out of memory\n");
+            exit(1);
+        }
+    }
+    memset(&chunk[chunks], 0, sizeof(*chunk));
+    return &chunk[chunks++];
+}
+
+static int load_text(FILE *f)
+{
+    char line[512];
+
+    while (fgets(line, sizeof(line), f)) {
+        char *p = line, *end;
+        double t = strtod(p, &end);
+        double scale = 1e-6;                    // us, bench_replay -d
+        chunk_t *c;
+
+        if (end == p)
+            continue;                           // comment, boot banner
+        p = end;
+        while (*p == ' ')
+            p++;
+        if (!strncmp(p, "ms", 2)) {             // sim frame dump
+            scale = 1e-3;
+            p += 2;
+        }
+        c = chunk_add();
+        c->t = t * scale;
+        for (;;) {
+            long b = strtol(p, &end, 16);
+
+            if (end == p || c->len >= (int)sizeof(c->data))
+                break;
+            c->data[c->len++] = (uint8_t)b;
+            p = end;
+        }
+        if (c->len == 0)
+            chunks--;
+    }
+    return chunks > 0;
+}
+
+static int load_raw(FILE *f, long baud)
+{
+    int b;
+    double t = 0.0;
+
+    while ((b = fgetc(f)) != EOF) {
+        chunk_t *c = chunk_add();
+
+        c->t = t;
+        c->data[c->len++] = (uint8_t)b;
+        t += 10.0 / baud;                       // start, 8 data, stop
+    }
+    return chunks > 0;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void sleep_until(double t)
+{
+    struct timespec ts;
+    double d = t - now_sec();
+
+    if (d <= 0)
+        return;
+    ts.tv_sec = (time_t)d;
+    ts.tv_nsec = (long)((d - ts.tv_sec) * 1e9);
+    nanosleep(&ts, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    int n = 1, raw = 0, loops = 1, errEvery = 0;
+    long baud = 4800;
+    double speed = 1.0, wait = 1.0, t0, base;
+    int *fd;
+    FILE *f;
+    size_t k;
+    int i, loop;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-n") && i + 1 < argc)       n = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-r"))                  raw = 1;
+        else if (!strcmp(argv[i], "-b") && i + 1 < argc)  baud = atol(argv[++i]);
+        else if (!strcmp(argv[i], "-x") && i + 1 < argc)  speed = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-e") && i + 1 < argc)  errEvery = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-w") && i + 1 < argc)  wait = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-l") && i + 1 < argc)  loops = atoi(argv[++i]);
+        else
+            break;
+    }
+    if (i + 1 != argc || n < 1 || baud <= 0) {
+        fprintf(stderr, "usage: %s [-n ptys] [-r] [-b baud] [-x speed] [-e n] [-w seconds] [-l loops] capture\n", argv[0]);
+        return 2;
+    }
+
+    f = fopen(argv[i], raw ? "rb" : "r");
+    if (!f) {
+        perror(argv[i]);
+        return 1;
+    }
+    if (!(raw ? load_raw(f, baud) : load_text(f))) {
+        fprintf(stderr, "%s: no frames\n", argv[i]);
+        return 1;
+    }
+    fclose(f);
+
+    fd = calloc(n, sizeof(*fd));
+    if (!fd) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < n; i++) {
+        struct termios tio;
+
+        fd[i] = posix_openpt(O_RDWR | O_NOCTTY);
+        if (fd[i] < 0 || grantpt(fd[i]) != 0 || unlockpt(fd[i]) != 0) {
+            perror("posix_openpt");
+            return 1;
+        }
+        if (tcgetattr(fd[i], &tio) == 0) {      // no echo back at us
+            cfmakeraw(&tio);
+            tcsetattr(fd[i], TCSANOW, &tio);
+        }
+        printf("%s\n", ptsname(fd[i]));
+    }
+    fflush(stdout);
+    sleep_until(now_sec() + wait);
+
+    srand(1);
+    t0 = now_sec();
+    base = 0.0;
+    for (loop = 0; loop < loops; loop++) {
+        for (k = 0; k < chunks; k++) {
+            const chunk_t *c = &chunk[k];
+
+            if (speed > 0)
+                sleep_until(t0 + (base + c->t - chunk[0].t) / speed);
+            for (i = 0; i < n; i++) {
+                uint8_t out[sizeof(c->data)];
+
+                memcpy(out, c->data, c->len);
+                if (errEvery > 0 && rand() % errEvery < c->len)
+                    out[rand() % c->len] ^= (uint8_t)(1 << (rand() & 7));
+                if (write(fd[i], out, c->len) != c->len) {
+                    perror("write");
+                    return 1;
+                }
+            }
+        }
+        base += chunk[chunks - 1].t - chunk[0].t + 0.25;
+    }
+
+    sleep_until(now_sec() + 0.5);               // let the reader drain
+    for (i = 0; i < n; i++)
+        close(fd[i]);
+    return 0;
+}
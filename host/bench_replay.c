@@ -0,0 +1,252 @@
+//******************************************************************************
+//  host/bench_replay.c - replay recorded SRM torque-line traces through the
+//  decoder and score it for speed and fidelity
+//
+//  The whole trace is loaded first, then every edge goes through
+//  srm_torque_pulse(), the decode the capture FIFO feeds, with the TA1CCR1
+//  value the edge would have latched, while the Timer1_A model raises the
+//  channel period slots.  The UART model runs as an ideal link so the frame
+//  sequence is exactly what the firmware asked to send.
+//
+//  Trace format, one record per line, times in microseconds:
+//      # comment
+//      P <t>                 torque line edge
+//      R <t> <ticks>         ground truth: revolution ends at t, <ticks>
+//                            torque ticks counted during it
+//
+//  usage: bench_replay [-l latency_ms] [-d frames.txt] trace.txt
+//         -l  decode latency allowed after a truth revolution (2 ms)
+//         -d  write every emitted frame, with its send time, to a file
+//
+//  Page 0x20 frames are scored the way a head unit reads them: event count,
+//  accumulated time stamp (1/2000 s) and torque ticks deltas between
+//  consecutive frames, checked against the truth revolutions in between.
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "hal.h"
+#include "ant.h"
+#include "srm.h"
+#include "log.h"
+
+typedef struct {
+    uint64_t t;
+    uint32_t ticks;
+} truth_t;
+
+typedef struct {
+    uint64_t t;                                 // when it was queued
+    uint8_t  data[TX_FRAME_MAX];
+} frame_t;
+
+static uint64_t *edge;
+static size_t edges, edgeCap;
+static truth_t *truth;
+static size_t truths, truthCap;
+static frame_t *frame;
+static size_t frames, frameCap;
+
+static uint8_t rx[TX_FRAME_MAX];
+static int rxLen;
+
+static void *grow(void *p, size_t *cap, size_t size)
+{
+    *cap = *cap ? *cap * 2 : 4096;
+    p = realloc(p, *cap * size);
+    if (!p) {
+        fprintf(stderr, "out of memory\n");
+        exit(1);
+    }
+    return p;
+}
+
+static void frame_sink(uint8_t byte, uint64_t t)
+{
+    if (rxLen == 0 && byte != 0xa4)
+        return;
+    rx[rxLen++] = byte;
+    if (rxLen < 2 || rxLen < rx[1] + 4)
+        return;
+
+    if (frames == frameCap)
+        frame = grow(frame, &frameCap, sizeof(*frame));
+    frame[frames].t = t;
+    memcpy(frame[frames].data, rx, rxLen);
+    frames++;
+    rxLen = 0;
+}
+
+static int load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[128];
+    unsigned long long t;
+    unsigned long ticks;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == 'P' && sscanf(line + 1, "%llu", &t) == 1) {
+            if (edges == edgeCap)
+                edge = grow(edge, &edgeCap, sizeof(*edge));
+            edge[edges++] = t;
+        }
+        else if (line[0] == 'R' && sscanf(line + 1, "%llu %lu", &t, &ticks) == 2) {
+            if (truths == truthCap)
+                truth = grow(truth, &truthCap, sizeof(*truth));
+            truth[truths].t = t;
+            truth[truths].ticks = ticks;
+            truths++;
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+static int is_ctf(const frame_t *f)
+{
+    return f->data[2] == 0x4e && f->data[4] == 0x20;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    const char *trace = NULL, *dump = NULL;
+    uint64_t latency = 2000;
+    double t0, sec;
+    size_t i, j, ctf = 0, decoded = 0, countErr = 0, scored = 0, within1 = 0;
+    double cadErrSum = 0, cadErrMax = 0;
+    uint64_t tickTruth = 0, tickDecoded = 0, tickErrSum = 0;
+    const frame_t *prev = NULL;
+    size_t prevTruth = 0;
+
+    for (i = 1; i < (size_t)argc; i++) {
+        if (!strcmp(argv[i], "-l") && i + 1 < (size_t)argc)       latency = atoi(argv[++i]) * 1000ULL;
+        else if (!strcmp(argv[i], "-d") && i + 1 < (size_t)argc)  dump = argv[++i];
+        else if (argv[i][0] != '-' && !trace)                     trace = argv[i];
+        else {
+            trace = NULL;
+            break;
+        }
+    }
+    if (!trace) {
+        fprintf(stderr, "usage: %s [-l latency_ms] [-d frames.txt] trace.txt\n", argv[0]);
+        return 2;
+    }
+    if (load(trace) < 0)
+        return 1;
+
+    sim_reset(frame_sink);
+    sim.uart_instant = 1;
+    log_init();                                 // revolutions go to the ride log too
+    Timer1_A_period_init();
+
+    //--------------------------------------------------------------------------
+    // Replay: capture = Timer1_A count at the edge
+    //--------------------------------------------------------------------------
+    t0 = now_sec();
+    for (i = 0; i < edges; i++) {
+        sim_run_until(edge[i]);                 // channel period slots
+        srm_torque_pulse((uint16_t)(edge[i] * SIM_TIMER1_HZ / SIM_SMCLK_HZ));
+    }
+    sec = now_sec() - t0;
+
+    //--------------------------------------------------------------------------
+    // Fidelity: a CTF frame covers every revolution since the previous one.
+    // Truth revolutions that ended at least <latency> before the frame are
+    // the ones it should contain.
+    //--------------------------------------------------------------------------
+    for (i = 0, j = 0; i < frames; i++) {
+        const frame_t *f = &frame[i];
+        uint8_t dev;
+        size_t revs;
+
+        if (!is_ctf(f))
+            continue;
+        ctf++;
+        while (j < truths && truth[j].t + latency <= f->t)
+            j++;                                // truth[0..j) done by now
+        if (!prev) {
+            prev = f;
+            prevTruth = j;
+            continue;
+        }
+
+        dev = (uint8_t)(f->data[5] - prev->data[5]);
+        revs = j - prevTruth;
+        decoded += dev;
+        if (dev != revs) {
+            countErr++;
+        }
+        else if (dev && prevTruth > 0) {
+            uint16_t dts = (uint16_t)(((f->data[8] << 8) | f->data[9]) - ((prev->data[8] << 8) | prev->data[9]));
+            uint16_t dtt = (uint16_t)(((f->data[10] << 8) | f->data[11]) - ((prev->data[10] << 8) | prev->data[11]));
+            double cadTruth = 60e6 * dev / (double)(truth[j - 1].t - truth[prevTruth - 1].t);
+            double cad = dts ? 60.0 * 2000.0 * dev / dts : 0.0;
+            double err = cad > cadTruth ? cad - cadTruth : cadTruth - cad;
+            uint64_t ticks = 0;
+            size_t k;
+
+            for (k = prevTruth; k < j; k++)
+                ticks += truth[k].ticks;
+            scored += dev;
+            cadErrSum += err * dev;
+            if (err > cadErrMax)
+                cadErrMax = err;
+            if (err <= 1.0)
+                within1 += dev;
+            tickTruth += ticks;
+            tickDecoded += dtt;
+            tickErrSum += dtt > ticks ? dtt - ticks : ticks - dtt;
+        }
+        prev = f;
+        prevTruth = j;
+    }
+
+    if (dump) {
+        FILE *d = fopen(dump, "w");
+        int k;
+
+        if (!d) {
+            perror(dump);
+            return 1;
+        }
+        for (i = 0; i < frames; i++) {
+            fprintf(d, "%llu", (unsigned long long)frame[i].t);
+            for (k = 0; k < frame[i].data[1] + 4; k++)
+                fprintf(d, " %02X", frame[i].data[k]);
+            fprintf(d, "\n");
+        }
+        fclose(d);
+    }
+
+    printf("edges            %zu\n", edges);
+    printf("decode           %.3f s  %.0f pulses/s  %.1f ns/pulse\n",
+           sec, sec > 0 ? edges / sec : 0.0, edges ? sec * 1e9 / edges : 0.0);
+    printf("frames           %zu  (CTF 0x20: %zu)\n", frames, ctf);
+    if (truths) {
+        printf("revolutions      truth %zu  decoded %zu  frames with wrong count %zu\n",
+               j, decoded, countErr);
+        if (scored) {
+            printf("cadence error    mean %.2f rpm  max %.2f rpm  within 1 rpm %.1f%%\n",
+                   cadErrSum / scored, cadErrMax, 100.0 * within1 / scored);
+            printf("torque ticks     truth %llu  decoded %llu  mean |err| %.2f /rev\n",
+                   (unsigned long long)tickTruth, (unsigned long long)tickDecoded,
+                   (double)tickErrSum / scored);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,244 @@
+//******************************************************************************
+//  host/logdump.c - turn a ride log download into CSV
+//
+//  Reads the bytes the converter sends with P1.3 held down at power-up
+//  (log.h: 0x5A 0xA5 block len data crc), from a serial capture or sim -l.
+//  Blocks are found by their sync and CRC, so line noise only costs the
+//  blocks it hits; a segment is decoded up to its first missing block.
+//
+//  One line per logged revolution:
+//      seq,rev,time_s,dt_ms,ticks,offset_hz,cadence_rpm,torque_nm,power_w,dropped
+//  time_s adds up the logged deltas, so revolutions the converter could not
+//  log (dropped, counted in the record after them) and segments the ring
+//  has overwritten are not in it.
+//
+//  usage: logdump [-s slope] [download.bin]      (stdin without a file)
+//         -s  slope in 1/10 Nm/Hz for torque and power (CAL_SLOPE_DEFAULT)
+//******************************************************************************
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cal.h"
+
+#ifndef M_PI
+#define M_PI        3.14159265358979323846
+#endif
+
+// log.h, without pulling in hal.h for the segment count
+#define LOG_SEG_SIZE        512
+#define LOG_HEADER          4
+#define LOG_MAGIC0          0x52
+#define LOG_MAGIC1          0x4C
+#define LOG_TAG_LONG        0xC0
+#define LOG_TAG_ABS         0xC1
+#define LOG_TAG_OFFSET      0xC2
+#define LOG_END             0xFF
+#define LOG_DL_SYNC0        0x5A
+#define LOG_DL_SYNC1        0xA5
+#define LOG_DL_BLOCK        64
+
+#define BLOCKS_MAX          1024                // 64 KB, far more than the part has
+
+static uint8_t data[BLOCKS_MAX * LOG_DL_BLOCK];
+static int     have[BLOCKS_MAX];
+static int     blocks;                          // highest block seen + 1
+
+static unsigned goodBlocks, badCrc, revs, dropped, segments;
+
+static uint16_t crc16(const uint8_t *p, int n)
+{
+    uint16_t crc = 0xFFFF;
+    int i;
+
+    while (n--) {
+        crc ^= (uint16_t)*p++ << 8;
+        for (i = 0; i < 8; i++)
+            crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+//------------------------------------------------------------------------------
+// Blocks
+//------------------------------------------------------------------------------
+static void load(const uint8_t *in, size_t n)
+{
+    size_t i = 0;
+
+    while (i + 7 <= n) {
+        const uint8_t *b = &in[i];
+        unsigned block, len;
+
+        if (b[0] != LOG_DL_SYNC0 || b[1] != LOG_DL_SYNC1) {
+            i++;
+            continue;
+        }
+        block = b[2] | b[3] << 8;
+        len = b[4];
+        if (len > LOG_DL_BLOCK || i + 7 + len > n
+            || crc16(&b[2], 3 + len) != (uint16_t)(b[5 + len] | b[6 + len] << 8)) {
+            badCrc++;
+            i++;                                // not a block here after all
+            continue;
+        }
+        i += 7 + len;
+        if (len == 0)
+            break;                              // end block
+        if (block >= BLOCKS_MAX || len != LOG_DL_BLOCK)
+            continue;
+        memcpy(&data[block * LOG_DL_BLOCK], &b[5], len);
+        have[block] = 1;
+        goodBlocks++;
+        if ((int)block + 1 > blocks)
+            blocks = block + 1;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Records
+//------------------------------------------------------------------------------
+static int varint(const uint8_t *s, int *pos, int end, uint16_t *v)
+{
+    int shift = 0;
+
+    *v = 0;
+    while (*pos < end && shift < 21) {
+        uint8_t b = s[(*pos)++];
+
+        *v |= (uint16_t)((b & 0x7F) << shift);
+        if (!(b & 0x80))
+            return 1;
+        shift += 7;
+    }
+    return 0;
+}
+
+static uint16_t unzigzag(uint16_t z)
+{
+    return (z >> 1) ^ (uint16_t)(0 - (z & 1));
+}
+
+static void segment(const uint8_t *s, int end, double slope, double *time)
+{
+    unsigned seq;
+    uint16_t dt = 0, dk = 0, offset = 0, gap = 0, t, k, v;
+    int pos = LOG_HEADER, base = 0;
+
+    if (end < LOG_HEADER || s[0] != LOG_MAGIC0 || s[1] != LOG_MAGIC1)
+        return;
+    seq = s[2] | s[3] << 8;
+    segments++;
+
+    while (pos < end) {
+        uint8_t tag = s[pos++];
+
+        gap = 0;
+        if (tag == LOG_END)
+            break;
+        if (tag == LOG_TAG_OFFSET) {
+            if (pos + 2 > end)
+                break;
+            offset = s[pos] | s[pos + 1] << 8;
+            pos += 2;
+            continue;
+        }
+        if (tag == LOG_TAG_ABS) {
+            if (!varint(s, &pos, end, &gap) || !varint(s, &pos, end, &dt)
+                || !varint(s, &pos, end, &dk))
+                break;
+            base = 1;
+        }
+        else if (!base)
+            break;                              // segment without its absolute record
+        else if (tag < 0x80) {
+            t = (uint16_t)((int16_t)(tag << 9) >> 13);      // bits 6..4, signed
+            k = (uint16_t)((int16_t)(tag << 12) >> 12);     // bits 3..0, signed
+            dt += t;
+            dk += k;
+        }
+        else if (tag < LOG_TAG_LONG) {
+            if (pos >= end)
+                break;
+            t = (uint16_t)((int16_t)(tag << 10) >> 10);     // bits 5..0, signed
+            k = (uint16_t)(int8_t)s[pos++];
+            dt += t;
+            dk += k;
+        }
+        else if (tag == LOG_TAG_LONG) {
+            if (!varint(s, &pos, end, &v))
+                break;
+            dt += unzigzag(v);
+            if (!varint(s, &pos, end, &v))
+                break;
+            dk += unzigzag(v);
+        }
+        else
+            break;                              // not a tag: garbage from here on
+
+        {
+            double elapsed = dt / 2000.0;
+            double cadence = elapsed > 0 ? 60.0 / elapsed : 0.0;
+            double hz = elapsed > 0 ? dk / elapsed - offset : 0.0;
+            double torque = hz * 10.0 / slope;
+
+            *time += elapsed;
+            revs++;
+            dropped += gap;
+            printf("%u,%u,%.3f,%.1f,%u,%u,%.1f,%.2f,%.1f,%u\n",
+                   seq, revs, *time, elapsed * 1e3, dk, offset, cadence,
+                   torque, torque * cadence * M_PI / 30.0, gap);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    double slope = CAL_SLOPE_DEFAULT, time = 0.0;
+    const int perSeg = LOG_SEG_SIZE / LOG_DL_BLOCK;
+    uint8_t *in = NULL;
+    size_t n = 0, cap = 0;
+    FILE *f = stdin;
+    int i, b, seg;
+
+    for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+        if (!strcmp(argv[i], "-s") && i + 1 < argc)       slope = atof(argv[++i]);
+        else
+            break;
+    }
+    if (i + 1 < argc || slope <= 0) {
+        fprintf(stderr, "usage: %s [-s slope] [download.bin]\n", argv[0]);
+        return 2;
+    }
+    if (i < argc && !(f = fopen(argv[i], "rb"))) {
+        perror(argv[i]);
+        return 1;
+    }
+    for (;;) {
+        if (n == cap) {
+            cap = cap ? cap * 2 : 65536;
+            in = realloc(in, cap);
+            if (!in) {
+                fprintf(stderr, "out of memory\n");
+                return 1;
+            }
+        }
+        size_t got = fread(&in[n], 1, cap - n, f);
+        if (got == 0)
+            break;
+        n += got;
+    }
+    load(in, n);
+
+    printf("seq,rev,time_s,dt_ms,ticks,offset_hz,cadence_rpm,torque_nm,power_w,dropped\n");
+    for (seg = 0; seg * perSeg < blocks; seg++) {
+        for (b = 0; b < perSeg && have[seg * perSeg + b]; b++)
+            ;
+        segment(&data[seg * LOG_SEG_SIZE], b * LOG_DL_BLOCK, slope, &time);
+    }
+    fprintf(stderr, "%u blocks, %u bad, %d missing; %u segments, %u revolutions, %u dropped\n",
+            goodBlocks, badCrc, blocks - (int)goodBlocks, segments, revs, dropped);
+    return 0;
+}
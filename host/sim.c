@@ -0,0 +1,454 @@
+//******************************************************************************
+//  host/sim.c - host models of the MSP430G2553 peripherals
+//
+//  Event driven: sim_run_until() steps from one Timer1_A compare hit or UART
+//  byte boundary to the next.  Each modelled vector posts the same event the
+//  target vector posts, then the main loop runs at once (event_run()), so
+//  the handlers in event.c see the same sequence as on the target.
+//******************************************************************************
+
+#include <string.h>
+
+#include "hal.h"
+#include "ant.h"
+#include "srm.h"
+#include "event.h"
+#include "lpm.h"
+
+#define SIM_UART_TBIT   (SIM_SMCLK_HZ / SIM_UART_BAUD)      // cycles per bit
+
+sim_t sim;
+
+// ACLK stops in LPM4, and Timer1_A with it
+static uint64_t timer1_ticks(uint64_t t)
+{
+    return (t - sim.t1_stopped) * SIM_TIMER1_HZ / SIM_SMCLK_HZ;
+}
+
+static uint64_t timer1_cycle(uint64_t tick)         // first cycle of tick
+{
+    return (tick * SIM_SMCLK_HZ + SIM_TIMER1_HZ - 1) / SIM_TIMER1_HZ + sim.t1_stopped;
+}
+
+static void sim_sleep(uint64_t t)                   // main loop sleeps till t
+{
+    uint8_t mode = lpm_mode();
+
+    if (mode == LPM_SLEEP4)
+        sim.t1_stopped += t - sim.now;
+    sim.lpm_cycles[mode] += t - sim.now;
+    sim.now = t;
+}
+
+//------------------------------------------------------------------------------
+// Timer1_A
+//------------------------------------------------------------------------------
+uint16_t sim_timer1_count(void)
+{
+    return (uint16_t)timer1_ticks(sim.now);
+}
+
+uint32_t hal_timer1_now32(void)
+{
+    return (uint32_t)timer1_ticks(sim.now);
+}
+
+static void timer1_slot_init(void)                  // Timer1_A_slot_arm()
+{
+    sim.t1_ccie2 = 1;
+    sim.slot_fraction += (uint16_t)ANT_CH_PER * lpmSlotDiv;
+    sim.t1_next_slot = timer1_ticks(sim.now) + (sim.slot_fraction >> 3);
+    sim.slot_fraction &= 7;
+}
+
+void Timer1_A_period_init(void)
+{
+    sim.t1_ccie0 = 0;
+    timer1_slot_init();
+}
+
+void Timer1_A_period_CAL_init(void)
+{
+    sim.t1_ccie0 = 1;
+    sim.t1_next_irq = timer1_ticks(sim.now) + kPeriod + 1;
+    timer1_slot_init();
+}
+
+void Timer1_A_slot_sync(void)                       // as in the main file
+{
+    uint64_t period = ((uint16_t)ANT_CH_PER * lpmSlotDiv) >> 3;
+    uint64_t at = timer1_ticks(sim.now) + ANT_SYNC_TICKS;
+
+    if (sim.t1_next_slot > at && sim.t1_next_slot - at > period / 2)
+        at += period;
+    sim.t1_next_slot = at;
+    sim.slot_fraction = 0;
+}
+
+//------------------------------------------------------------------------------
+// AP1: a command is answered RESPONSE_NO_ERROR (or the error code for
+// ant_nak_id, once), a reset by the startup message.  The answer starts
+// 1 ms after the frame and reaches the RX path as a whole when its last
+// byte would have arrived.  Channel 0 and 1, once open, broadcast every
+// channel period on the AP1's clock (ant_ppm off ACLK for channel 0) and
+// raise EVENT_TX after each, whether or not a page came in for it, like
+// the real module.  Channel 0 counts what each broadcast carried: the
+// page loaded since the one before, that page again, or the last of
+// several with the others lost.
+//------------------------------------------------------------------------------
+#define SIM_ANT_NAK_CODE    0x15                // CHANNEL_IN_WRONG_STATE
+
+static void ant_reply(uint8_t id, uint8_t a, uint8_t b, uint8_t c, int size)
+{
+    uint8_t *r = sim.ant_reply;
+    int i;
+
+    r[0] = ANT_SYNC;
+    r[1] = (uint8_t)size;
+    r[2] = id;
+    r[3] = a;
+    r[4] = b;
+    r[5] = c;
+    r[size + 3] = 0;
+    for (i = 0; i < size + 3; i++)
+        r[size + 3] ^= r[i];
+    sim.ant_reply_len = size + 4;
+    sim.ant_reply_at = sim.now + 1000 + (uint64_t)sim.ant_reply_len * 10 * SIM_UART_TBIT;
+}
+
+static double ant_ch_cycles(void)                   // channel 0 period, SMCLK cycles
+{
+    return sim.ant_ch_per * (double)SIM_SMCLK_HZ / SIM_ACLK_HZ * (1.0 + sim.ant_ppm * 1e-6);
+}
+
+static void ant_module_byte(uint8_t byte)
+{
+    uint8_t *f = sim.ant_frame;
+    uint8_t code = RESPONSE_NO_ERROR;
+
+    if (!sim.ant_module || (sim.ant_frame_len == 0 && byte != ANT_SYNC))
+        return;
+    f[sim.ant_frame_len++] = byte;
+    if (sim.ant_frame_len < 2 || sim.ant_frame_len < f[1] + 4)
+        return;
+    sim.ant_frame_len = 0;
+
+    if (f[2] == MESG_SYSTEM_RESET_ID) {
+        ant_reply(MESG_STARTUP_MESG_ID, 0x20, 0, 0, 1);     // power on / command reset
+    }
+    else if (f[2] == MESG_BROADCAST_DATA_ID) {
+        if (f[3] == ANT_CH_ID)
+            sim.ant_ch_loaded++;
+    }
+    else {
+        if (f[2] == sim.ant_nak_id) {
+            code = SIM_ANT_NAK_CODE;
+            sim.ant_nak_id = -1;
+        }
+        else if (f[2] == 0x4B && f[3] == ANT_CAD_CH_ID) {    // open channel 1
+            sim.ant_cad_open = 1;
+            sim.ant_cad_next = sim.now * SIM_ACLK_HZ / SIM_SMCLK_HZ + ANT_CAD_CH_PER;
+        }
+        else if (f[2] == 0x43 && f[3] == ANT_CH_ID) {        // channel 0 period
+            sim.ant_ch_per = f[4] | f[5] << 8;
+        }
+        else if (f[2] == 0x4B && f[3] == ANT_CH_ID) {        // open channel 0
+            sim.ant_ch_open = 1;
+            sim.ant_ch_next = sim.now + ant_ch_cycles();
+        }
+        ant_reply(MESG_RESPONSE_EVENT_ID, f[3], f[2], code, 3);
+    }
+}
+
+// A frame from the AP1 reaches the MCU.  The Timer_A UART catches the start
+// bit with a capture on SMCLK: asleep below LPM0, or held by a flash erase
+// (held), it hears nothing of it.  USCI_A0 asks for SMCLK itself.
+static void ant_to_mcu(const uint8_t *f, int len, int held)
+{
+    int i;
+
+#ifndef UART_USCI_A0
+    if (held || (!sim.cpu_busy && lpm_mode() != LPM_SLEEP0)) {
+        sim.ant_rx_deaf++;
+        return;
+    }
+#else
+    (void)held;
+#endif
+    for (i = 0; i < len; i++)
+        rx_push(f[i]);                              // Timer_A1_ISR / USCI0RX_ISR
+    event_post(EV_RX);
+    event_run();                                    // main loop wakes up
+}
+
+static void ant_tx_event(uint8_t ch, int held)
+{
+    const uint8_t ev[] = {
+        ANT_SYNC, 3, MESG_RESPONSE_EVENT_ID, ch, MESG_EVENT_ID, EVENT_TX,
+        ANT_SYNC ^ 3 ^ MESG_RESPONSE_EVENT_ID ^ ch ^ MESG_EVENT_ID ^ EVENT_TX
+    };
+
+    ant_to_mcu(ev, sizeof(ev), held);
+}
+
+static void ant_cad_event(int held)
+{
+    sim.ant_cad_next += ANT_CAD_CH_PER;
+    ant_tx_event(ANT_CAD_CH_ID, held);
+}
+
+static void ant_ch_event(int held)
+{
+    sim.ant_ch_next += ant_ch_cycles();
+    if (sim.ant_ch_loaded == 0)
+        sim.ant_air_repeats++;
+    else {
+        sim.ant_air_pages++;
+        sim.ant_air_lost += sim.ant_ch_loaded - 1;
+    }
+    sim.ant_ch_loaded = 0;
+    ant_tx_event(ANT_CH_ID, held);
+}
+
+static void ant_reply_done(int held)
+{
+    int len = sim.ant_reply_len;
+
+    sim.ant_reply_len = 0;
+    ant_to_mcu(sim.ant_reply, len, held);
+}
+
+//------------------------------------------------------------------------------
+// ANT link UART: first byte ends 11 bit times after the kick (one bit of
+// set-up, start, 8 data, stop), chained bytes every 10 bit times.  With
+// uart_instant set the queue is handed to the sink at once, sim.now.
+//------------------------------------------------------------------------------
+void UART_tx_start(void)
+{
+    int byte;
+
+    if (sim.uart_instant) {
+        while ((byte = txNextByte()) >= 0) {
+            sim.uart_bytes++;
+            if (sim.uart_sink)
+                sim.uart_sink((uint8_t)byte, sim.now);
+            ant_module_byte((uint8_t)byte);
+        }
+        return;
+    }
+    if (sim.uart_busy)
+        return;
+    byte = txNextByte();
+    if (byte < 0)
+        return;
+    lpm_claim(LPM_UART_TX);
+    sim.uart_busy = 1;
+    sim.uart_byte = byte;
+    sim.uart_done = sim.now + 11 * SIM_UART_TBIT;
+}
+
+// Startup only, as on the target: the main loop is not running
+void UART_tx_wait(void)
+{
+    while (sim.uart_busy)
+        hal_delay_100us();
+}
+
+static void uart_byte_done(void)
+{
+    sim.uart_bytes++;
+    if (sim.uart_sink)
+        sim.uart_sink((uint8_t)sim.uart_byte, sim.now);
+    ant_module_byte((uint8_t)sim.uart_byte);
+
+    sim.uart_byte = txNextByte();
+    if (sim.uart_byte < 0) {
+        sim.uart_busy = 0;
+        lpm_release(LPM_UART_TX);
+    }
+    else
+        sim.uart_done += 10 * SIM_UART_TBIT;
+}
+
+//------------------------------------------------------------------------------
+// Info flash: erase to 0xFF, then program
+//------------------------------------------------------------------------------
+void hal_info_write(const void *data, uint8_t size)
+{
+    if (size > sizeof(sim.info_d))
+        return;
+    memset(sim.info_d, 0xFF, sizeof(sim.info_d));
+    memcpy(sim.info_d, data, size);
+    sim.info_writes++;
+}
+
+//------------------------------------------------------------------------------
+// Ride log flash: erase a 512 byte segment to 0xFF; programming only clears
+// bits, as on the part, so a write over unerased flash shows up as garbage.
+// The erase holds the CPU for SIM_LOG_ERASE cycles: the clock moves on, and
+// vectors due meanwhile run once the main loop is back in sim_run_until().
+// Torque edges in it go to the CCR1 latch (sim_torque_edge()).
+//------------------------------------------------------------------------------
+void hal_log_erase(uint16_t at)
+{
+    at &= ~(uint16_t)511;
+    if (at >= sizeof(sim.log_flash))
+        return;
+    memset(&sim.log_flash[at], 0xFF, 512);
+    sim.log_erases++;
+    sim.now += SIM_LOG_ERASE;
+}
+
+void hal_log_write(uint16_t at, const uint8_t *data, uint8_t size)
+{
+    while (size-- && at < sizeof(sim.log_flash)) {
+        sim.log_flash[at++] &= *data++;
+        sim.log_bytes++;
+    }
+}
+
+//------------------------------------------------------------------------------
+// Simulation control
+//------------------------------------------------------------------------------
+void sim_reset(sim_uart_sink_t sink)
+{
+    static int erased;
+    sim_t zero = { 0 };
+
+    if (!erased) {
+        memset(zero.info_d, 0xFF, sizeof(zero.info_d));
+        memset(zero.log_flash, 0xFF, sizeof(zero.log_flash));
+        erased = 1;
+    }
+    else {
+        memcpy(zero.info_d, sim.info_d, sizeof(zero.info_d));
+        memcpy(zero.log_flash, sim.log_flash, sizeof(zero.log_flash));
+    }
+    sim = zero;
+    sim.uart_sink = sink;
+    sim.ant_nak_id = -1;
+    sim.ant_ch_per = 8192;                          // AP1 default until 0x43
+    sim.sp = sizeof(sim.stack) - 4;                 // main() frame, reset vector
+}
+
+static void capture_latched(void)               // TIMER1_A1 after the CPU is back
+{
+    sim.t1_latched = 0;
+    if (sim.t1_cov) {
+        sim.t1_cov = 0;
+        captureMissed++;
+    }
+    sim.irq_capture++;
+    capture_push(sim.t1_ccr1);
+    event_post(EV_CAPTURE);
+    event_run();
+}
+
+void sim_run_until(uint64_t t)
+{
+    if (sim.t1_latched && t >= sim.now)
+        capture_latched();
+    for (;;) {
+        uint64_t next = UINT64_MAX;
+        int which = 0;
+        int held;
+        int t1_runs = lpm_mode() != LPM_SLEEP4;
+
+        if (t1_runs && sim.t1_ccie0 && timer1_cycle(sim.t1_next_irq) < next) {
+            next = timer1_cycle(sim.t1_next_irq);
+            which = 1;
+        }
+        if (sim.uart_busy && sim.uart_done < next) {
+            next = sim.uart_done;
+            which = 2;
+        }
+        if (t1_runs && sim.t1_ccie2 && timer1_cycle(sim.t1_next_slot) < next) {
+            next = timer1_cycle(sim.t1_next_slot);
+            which = 3;
+        }
+        if (sim.ant_reply_len && sim.ant_reply_at < next) {
+            next = sim.ant_reply_at;
+            which = 4;
+        }
+        if (sim.ant_cad_open
+            && sim.ant_cad_next * SIM_SMCLK_HZ / SIM_ACLK_HZ < next) {
+            next = sim.ant_cad_next * SIM_SMCLK_HZ / SIM_ACLK_HZ;
+            which = 5;
+        }
+        if (sim.ant_ch_open && (uint64_t)sim.ant_ch_next < next) {
+            next = (uint64_t)sim.ant_ch_next;
+            which = 6;
+        }
+        if (next > t)
+            break;
+
+        held = next < sim.now;                      // due while the CPU was held
+        if (!held)
+            sim_sleep(next);
+        if (which == 1) {
+            sim.t1_next_irq += kPeriod + 1;
+            sim.irq_timer1++;
+            event_post(EV_CAL_TICK);                // TIMER1_A0
+            event_run();                            // main loop wakes up
+        }
+        else if (which == 2) {
+            uart_byte_done();                       // Timer_A0_ISR
+        }
+        else if (which == 4) {
+            ant_reply_done(held);
+        }
+        else if (which == 5) {
+            ant_cad_event(held);
+        }
+        else if (which == 6) {
+            ant_ch_event(held);
+        }
+        else {
+            sim.slot_fraction += (uint16_t)ANT_CH_PER * lpmSlotDiv;    // TIMER1_A1, TA1CCR2
+            sim.t1_next_slot += sim.slot_fraction >> 3;
+            sim.slot_fraction &= 7;
+            sim.irq_slot++;
+            event_post(EV_SLOT);
+            event_run();                            // main loop wakes up
+        }
+    }
+    if (t > sim.now)
+        sim_sleep(t);
+}
+
+void sim_torque_edge(uint64_t t)
+{
+    sim_run_until(t);
+    if (t < sim.now) {                              // CPU held by a flash erase
+        if (sim.t1_latched) {
+            sim.t1_cov = 1;                         // COV, the one before is gone
+            sim.log_lost_edges++;
+        }
+        sim.t1_latched = 1;
+        sim.t1_ccr1 = (uint16_t)timer1_ticks(t);
+        return;
+    }
+    if (lpm_mode() == LPM_SLEEP4) {                 // P2.2 armed as a port interrupt:
+        sim.irq_port2++;                            // Port_2 takes the edge, not CCR1
+        lpm_claim(LPM_CAPTURE);
+        return;
+    }
+    sim.irq_capture++;
+    capture_push(sim_timer1_count());               // TIMER1_A1
+    event_post(EV_CAPTURE);
+    event_run();                                    // main loop wakes up
+}
+
+void sim_mode_switch(uint64_t t)
+{
+    sim_run_until(t);
+    sim.irq_port1++;
+    event_post(EV_MODE);                            // Port_1
+    event_run();
+}
+
+void sim_uart_flush(void)
+{
+    while (sim.uart_busy)
+        sim_run_until(sim.uart_done);
+}
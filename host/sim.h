@@ -0,0 +1,159 @@
+//******************************************************************************
+//  host/sim.h - host models of the MSP430G2553 peripherals
+//
+//  Pulled in by hal.h when HOST_SIM is defined.  Time runs in SMCLK cycles
+//  (1 MHz, so one cycle per microsecond); ACLK is 32768 Hz and Timer1_A
+//  counts ACLK/8 exactly like main() sets it up on the target.
+//
+//    Timer1_A   continuous, CCR0 compare tick (OFFSETMODE), CCR1 capture
+//    UART       Timer_A or USCI_A0 ANT link, modelled one byte at a time
+//    GPIO       P1.0/P1.6 LEDs, P1.3 mode switch, P2.2 torque input (port
+//               interrupt instead of capture while lpm.h picks LPM4)
+//    Flash      info segment D, the ride log segments in main flash; a ride
+//               log erase holds the CPU, CCR1 latches the last edge of it
+//    AP1        the ANT module: answers commands; an open channel 0 or 1
+//               broadcasts every channel period on the AP1's own clock and
+//               raises EVENT_TX after it.  With the Timer_A UART the MCU
+//               hears nothing below LPM0 unless it is busy waiting.
+//******************************************************************************
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+
+typedef unsigned short hal_istate_t;
+
+#define SIM_SMCLK_HZ        1000000UL
+#define SIM_ACLK_HZ         32768UL
+#define SIM_TIMER1_DIV      8                   // BCSCTL1 |= DIVA_3
+#define SIM_TIMER1_HZ       (SIM_ACLK_HZ / SIM_TIMER1_DIV)
+#define SIM_UART_BAUD       UART_BAUD           // hal.h
+#define SIM_LOG_SIZE        4096                // as HAL_LOG_SIZE on the target
+#define SIM_LOG_ERASE       14500               // cycles the segment erase holds the CPU
+
+#define SIM_P1_LED_MODE     0x01                // P1.0
+#define SIM_P1_LED_CADENCE  0x40                // P1.6
+
+
+typedef void (*sim_uart_sink_t)(uint8_t byte, uint64_t t);
+
+typedef struct {
+    uint64_t now;                               // SMCLK cycles since reset
+
+    // Timer1_A, continuous from reset but for the LPM4 sleeps
+    uint64_t t1_stopped;                        // SMCLK cycles spent in LPM4
+    int      t1_ccie0;                          // CCR0 compare interrupt on
+    uint64_t t1_next_irq;                       // Timer1 tick of next CCR0 hit
+    int      t1_ccie2;                          // CCR2 channel slot interrupt on
+    uint64_t t1_next_slot;                      // Timer1 tick of next CCR2 hit
+    unsigned slot_fraction;                     // as slotFraction in the main file
+    int      t1_latched;                        // CCR1 captured while the CPU was held
+    uint16_t t1_ccr1;                           // that capture, the last one
+    int      t1_cov;                            // and an edge before it was lost
+
+    // ANT link UART
+    int      uart_instant;                      // ideal link: drain at once
+    int      uart_busy;
+    uint64_t uart_done;                         // cycle the byte on the line ends
+    int      uart_byte;
+    sim_uart_sink_t uart_sink;
+    uint32_t uart_bytes;
+
+    // ANT module on the other end of the UART
+    int      ant_module;                        // answer frames at all
+    int      ant_nak_id;                        // refuse this command once
+    uint8_t  ant_frame[16];                     // frame coming in from the MSP430
+    int      ant_frame_len;
+    uint8_t  ant_reply[16];                     // answer on its way back
+    int      ant_reply_len;
+    uint64_t ant_reply_at;
+    int      ant_cad_open;                      // channel 1 open: EVENT_TX per period
+    uint64_t ant_cad_next;                      // ACLK tick of its next EVENT_TX
+    int      ant_ch_open;                       // channel 0 open: broadcast per period
+    unsigned ant_ch_per;                        // its period, 1/32768 s (0x43)
+    double   ant_ch_next;                       // cycle of its next broadcast
+    double   ant_ppm;                           // AP1 clock error against ACLK, ppm
+    int      ant_ch_loaded;                     // pages loaded since the last broadcast
+    uint32_t ant_air_pages;                     // broadcasts of a page loaded for them
+    uint32_t ant_air_repeats;                   // broadcasts of the page before again
+    uint32_t ant_air_lost;                      // pages replaced before they went out
+    uint32_t ant_rx_deaf;                       // frames the MCU did not hear
+
+    // info flash segment D
+    uint8_t  info_d[64];
+    uint32_t info_writes;
+
+    // main flash the ride log uses
+    uint8_t  log_flash[SIM_LOG_SIZE];
+    uint32_t log_erases;
+    uint32_t log_bytes;
+    uint32_t log_lost_edges;                    // torque edges lost in the erase stalls
+
+    // GPIO
+    uint8_t  p1out;
+
+    // RAM: the stack region stack.c paints; the host's own stack is
+    // elsewhere, so the high-water mark stays where the test puts it
+    uint8_t  stack[80];                         // CCS default --stack_size
+    int      sp;                                // index, as the SP after boot
+
+    // time the main loop sleeps in each mode lpm_mode() picks
+    uint64_t lpm_cycles[3];
+
+    int      cpu_busy;                          // main loop busy waiting, not asleep
+
+    // interrupt counters
+    uint32_t irq_port1;
+    uint32_t irq_port2;                         // torque wake from LPM4
+    uint32_t irq_capture;
+    uint32_t irq_timer1;
+    uint32_t irq_slot;
+} sim_t;
+
+extern sim_t sim;
+
+//------------------------------------------------------------------------------
+// hal.h names, host flavour
+//------------------------------------------------------------------------------
+// The simulation is single threaded and "interrupts" never nest
+static inline hal_istate_t hal_irq_save(void)   { return 0; }
+static inline void hal_irq_restore(hal_istate_t state) { (void)state; }
+
+static inline void hal_led_mode_off(void)       { sim.p1out &= ~SIM_P1_LED_MODE; }
+static inline void hal_led_mode_toggle(void)    { sim.p1out ^= SIM_P1_LED_MODE; }
+static inline void hal_led_cadence_off(void)    { sim.p1out &= ~SIM_P1_LED_CADENCE; }
+static inline void hal_led_cadence_toggle(void) { sim.p1out ^= SIM_P1_LED_CADENCE; }
+
+void sim_run_until(uint64_t t);
+static inline void hal_delay_100us(void)
+{
+    sim.cpu_busy++;
+    sim_run_until(sim.now + 100);
+    sim.cpu_busy--;
+}
+static inline uint16_t hal_prof_now(void)       { return (uint16_t)sim.now; }
+
+uint16_t sim_timer1_count(void);
+static inline uint16_t hal_timer1_now(void)     { return sim_timer1_count(); }
+
+#define HAL_INFO_SEG_SIZE   64
+static inline const void *hal_info_segment(void) { return sim.info_d; }
+
+#define HAL_LOG_SIZE        SIM_LOG_SIZE
+static inline const uint8_t *hal_log_flash(void) { return sim.log_flash; }
+
+static inline uint8_t *hal_stack_low(void)      { return sim.stack; }
+static inline uint8_t *hal_stack_high(void)     { return sim.stack + sizeof(sim.stack); }
+static inline uint8_t *hal_stack_pointer(void)  { return sim.stack + sim.sp; }
+
+//------------------------------------------------------------------------------
+// Simulation control
+//------------------------------------------------------------------------------
+void     sim_reset(sim_uart_sink_t sink);   // flash survives, like a power cycle
+void     sim_run_until(uint64_t t);         // run timers and UART up to cycle t
+uint16_t sim_timer1_count(void);            // TA1R at sim.now
+void     sim_torque_edge(uint64_t t);       // P2.2 falling edge -> TA1CCR1
+void     sim_mode_switch(uint64_t t);       // P1.3 falling edge -> Port_1
+void     sim_uart_flush(void);              // run until the TX queue is empty
+
+#endif // SIM_H
@@ -0,0 +1,203 @@
+//******************************************************************************
+//  host/sim_main.c - run the converter core against the peripheral models
+//
+//  Boots like main() does (ANT config frames, each one acknowledged by the
+//  AP1 model, then Timer1_A free running), then
+//  feeds a synthetic SRM torque line into P2.2 and prints every ANT frame the
+//  UART model puts on the wire.  The decode path is also timed on the host
+//  so hot spots can be profiled (perf, gprof) before flashing.
+//
+//  usage: sim [-r rpm] [-f torque_hz] [-s seconds] [-p presses] [-n msg_id]
+//             [-k ppm] [-l log.bin] [-q]
+//         -r  0 = cranks standing still (no cadence marker), e.g. with -p 1
+//         -f  0 = torque line quiet too (SRM asleep): idle policy, LPM4
+//         -p  press the P1.3 mode switch n times after boot
+//         -n  the module refuses this configuration command once
+//         -k  the AP1's clock runs this many ppm fast (negative: slow)
+//         -l  after the ride, power up again with P1.3 held and write the
+//             ride log download to this file (host/logdump.c reads it)
+//         -q  summary only, no frame dump
+//******************************************************************************
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "hal.h"
+#include "ant.h"
+#include "srm.h"
+#include "cal.h"
+#include "power.h"
+#include "stack.h"
+#include "log.h"
+#include "lpm.h"
+
+#define TICKET_PULSES       2       // fine pulses per torque ticket
+#define CADENCE_PULSES      16      // fine pulses in the once-per-rev marker
+#define FINE_PULSE_GAP      10      // us between fine pulses
+
+static int quiet;
+static uint8_t frame[TX_FRAME_MAX];
+static int frameLen;
+static uint32_t frames;
+static FILE *logOut;                        // -l: the download goes here
+
+static void frame_sink(uint8_t byte, uint64_t t)
+{
+    int i;
+
+    if (logOut) {
+        fputc(byte, logOut);
+        return;
+    }
+    if (frameLen == 0 && byte != 0xa4)          // hunt for sync
+        return;
+    frame[frameLen++] = byte;
+    if (frameLen < 2 || frameLen < frame[1] + 4)
+        return;
+
+    frames++;
+    if (!quiet) {
+        printf("%10.3f ms ", t / 1000.0);
+        for (i = 0; i < frameLen; i++)
+            printf(" %02X", frame[i]);
+        printf("\n");
+    }
+    frameLen = 0;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int main(int argc, char **argv)
+{
+    double rpm = 90.0, torque_hz = 600.0, seconds = 10.0, ppm = 0.0;
+    int presses = 0;
+    int nak = -1;
+    const char *logPath = NULL;
+    uint8_t boot;
+    uint64_t t, rev, end, next_rev;
+    uint32_t edges = 0;
+    double decode_sec = 0.0, t0;
+    int i;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-r") && i + 1 < argc)       rpm = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-f") && i + 1 < argc)  torque_hz = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-s") && i + 1 < argc)  seconds = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-p") && i + 1 < argc)  presses = atoi(argv[++i]);
+        else if (!strcmp(argv[i], "-n") && i + 1 < argc)  nak = (int)strtol(argv[++i], NULL, 0);
+        else if (!strcmp(argv[i], "-k") && i + 1 < argc)  ppm = atof(argv[++i]);
+        else if (!strcmp(argv[i], "-l") && i + 1 < argc)  logPath = argv[++i];
+        else if (!strcmp(argv[i], "-q"))                  quiet = 1;
+        else {
+            fprintf(stderr, "usage: %s [-r rpm] [-f torque_hz] [-s seconds] [-p presses] [-n msg_id] [-k ppm] [-l log.bin] [-q]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    sim_reset(frame_sink);
+    stack_paint();
+    sim.ant_module = 1;
+    sim.ant_nak_id = nak;
+    sim.ant_ppm = ppm;
+    cal_load();
+    log_init();
+
+    // same order as main()
+    boot = antBoot();
+    if (boot != ANT_BOOT_FRAMES) {
+        printf("boot failed at frame %u, error 0x%04X\n", boot, antBootError);
+        return 1;
+    }
+    sim_uart_flush();
+    printf("boot %.1f ms  (last refusal 0x%04X)\n", sim.now / 1000.0, antBootError);
+    Timer1_A_period_init();
+    lpm_claim(LPM_CAPTURE | LPM_SLOT);
+#if defined(ANT_CAD_CHANNEL) && !defined(UART_USCI_A0)
+    lpm_claim(LPM_UART_RX);                 // as main(): the Timer_A RX needs SMCLK
+#endif
+    for (i = 0; i < presses; i++)
+        sim_mode_switch(sim.now + 100000);      // 100 ms apart
+
+    rev = rpm > 0 ? (uint64_t)(SIM_SMCLK_HZ * 60.0 / rpm) : 0;
+    end = sim.now + (uint64_t)(SIM_SMCLK_HZ * seconds);
+    next_rev = rev ? sim.now + rev : UINT64_MAX;
+
+    for (t = sim.now; torque_hz > 0 && t < end; t += (uint64_t)(SIM_SMCLK_HZ / torque_hz)) {
+        int n = TICKET_PULSES;
+
+        if (t >= next_rev) {                    // cadence marker burst
+            n = CADENCE_PULSES;
+            next_rev += rev;
+        }
+        for (i = 0; i < n; i++) {
+            sim_run_until(t + i * FINE_PULSE_GAP);
+            t0 = now_sec();
+            sim_torque_edge(t + i * FINE_PULSE_GAP);
+            decode_sec += now_sec() - t0;
+            edges++;
+        }
+    }
+    sim_run_until(end);
+    sim_uart_flush();
+
+    printf("edges %lu  frames %lu  uart bytes %lu  timer1 irqs %lu  slots %lu\n",
+           (unsigned long)edges, (unsigned long)frames,
+           (unsigned long)sim.uart_bytes, (unsigned long)sim.irq_timer1,
+           (unsigned long)sim.irq_slot);
+    printf("tx queue high water %u  overflow %u\n",
+           (unsigned)txQueueHighWater, (unsigned)txQueueOverflow);
+    printf("rx EVENT_TX %u  bad frames %u  overflow %u  not heard %lu\n",
+           (unsigned)antTxEvents, (unsigned)rxBadFrames, (unsigned)rxOverflow,
+           (unsigned long)sim.ant_rx_deaf);
+    printf("on air: new pages %lu  repeats %lu  pages replaced unsent %lu\n",
+           (unsigned long)sim.ant_air_pages, (unsigned long)sim.ant_air_repeats,
+           (unsigned long)sim.ant_air_lost);
+    if (unqomode == CTMMODE)
+        printf("power %u W  cadence %u rpm  3 s %u W  10 s %u W  events %u\n",
+               (unsigned)powerWatts, (unsigned)powerCadence, (unsigned)powerAvg3,
+               (unsigned)powerAvg10, (unsigned)powerEvent);
+    if (unqomode == OFFSETMODE)
+        printf("calibration %s  mean %.2f Hz  sd %.2f Hz  samples %u  offset %u Hz  flash writes %lu\n",
+               calState == CAL_SETTLED ? "settled" : "running", (calMeanAcc >> CAL_EWMA_SHIFT) / 16.0,
+               sqrt((calVarAcc >> CAL_EWMA_SHIFT) / 16.0), (unsigned)calSamples, (unsigned)zeroOffset,
+               (unsigned long)sim.info_writes);
+    printf("sleep LPM0 %.1f s  LPM3 %.1f s  LPM4 %.1f s  slot every %u periods  torque wakes %lu\n",
+           sim.lpm_cycles[LPM_SLEEP0] / (double)SIM_SMCLK_HZ,
+           sim.lpm_cycles[LPM_SLEEP3] / (double)SIM_SMCLK_HZ,
+           sim.lpm_cycles[LPM_SLEEP4] / (double)SIM_SMCLK_HZ,
+           (unsigned)lpmSlotDiv, (unsigned long)sim.irq_port2);
+    printf("ride log %u records  %u dropped  %lu bytes  %lu erases  %lu edges lost in them\n",
+           (unsigned)logRecords, (unsigned)logDropped,
+           (unsigned long)sim.log_bytes, (unsigned long)sim.log_erases,
+           (unsigned long)sim.log_lost_edges);
+    if (edges)
+        printf("capture+decode path %.1f ns/edge on host\n", decode_sec * 1e9 / edges);
+
+    if (logPath) {                          // power cycle, P1.3 held down
+        uint64_t t_dl;
+
+        logOut = fopen(logPath, "wb");
+        if (!logOut) {
+            perror(logPath);
+            return 1;
+        }
+        sim_reset(frame_sink);
+        log_init();
+        t_dl = sim.now;
+        log_download_start();
+        sim_uart_flush();
+        fclose(logOut);
+        printf("log download %lu bytes in %.1f ms\n",
+               (unsigned long)sim.uart_bytes, (sim.now - t_dl) / 1000.0);
+    }
+    return 0;
+}
@@ -0,0 +1,395 @@
+//******************************************************************************
+//  log.c - per-revolution ride log in main flash
+//
+//  Format and erase policy in log.h.  The writer only ever opens the
+//  segment after the one it wrote last, and after a power cycle carries on
+//  in it, so ring order from the segment after the newest one is oldest
+//  first, which is the order the download sends them in.
+//******************************************************************************
+
+#include "hal.h"
+#include "log.h"
+#include "srm.h"
+#include "cal.h"
+#include "lpm.h"
+
+#if LOG_SEGS < LOG_AHEAD + 2 || LOG_SEGS > 16
+#error "ride log: HAL_LOG_SIZE must be 4..16 segments of 512 bytes"
+#endif
+
+#define LOG_REC_MAX         13                // offset 3, absolute 1 + 3 varints
+
+uint16_t logErased;
+uint16_t logRecords;
+uint16_t logDropped;
+volatile uint8_t logDownload;
+
+static uint8_t  logSeg;                       // segment written last
+static uint16_t logPos;                       // next byte in it, LOG_SEG_SIZE: full
+static uint16_t logSeq;                       // seq of the next segment opened
+static uint16_t logStamp;                     // ctf_time_stamp1 at the last revolution
+static uint16_t logTicks;                     // ctf_torque_ticks1 at the last revolution
+static uint16_t logDt;                        // deltas of the last logged revolution
+static uint16_t logDk;
+static uint16_t logOffset;                    // zero offset the records use
+static uint8_t  logFresh;                     // next record absolute, offset first
+static uint16_t logGap;                       // revolutions dropped since the last record
+static uint8_t  logIdle;                      // slots since the last revolution
+
+enum{
+    DL_SYNC0 = 0,
+    DL_SYNC1,
+    DL_BLOCK_LO,
+    DL_BLOCK_HI,
+    DL_LEN,
+    DL_DATA,
+    DL_CRC_LO,
+    DL_CRC_HI
+};
+
+static uint8_t  dlStep;                       // DL_ byte of the block going out
+static uint8_t  dlSeg;                        // segment being sent
+static uint8_t  dlLeft;                       // segments left to look at, dlSeg included
+static uint16_t dlPos;                        // next byte of dlSeg
+static uint16_t dlBlock;
+static uint8_t  dlLen;
+static uint8_t  dlSent;
+static uint16_t dlCrc;
+
+// CRC-16/CCITT a nibble at a time: two lookups a byte in the UART ISR
+static const uint16_t crcNibble[16] = {
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+
+static uint8_t log_next(uint8_t seg)
+{
+    return seg + 1 == LOG_SEGS ? 0 : seg + 1;
+}
+
+static const uint8_t *log_segment(uint8_t seg)
+{
+    return hal_log_flash() + (uint16_t)seg * LOG_SEG_SIZE;
+}
+
+static uint8_t log_valid(uint8_t seg)
+{
+    const uint8_t *s = log_segment(seg);
+
+    return s[0] == LOG_MAGIC0 && s[1] == LOG_MAGIC1;
+}
+
+
+//------------------------------------------------------------------------------
+// Where the records in a segment end, read the way host/logdump.c reads
+// them.  A record cut short by a power loss reads on over the 0xFF after
+// it, like in the decoder, so the next record still starts where both
+// expect it; one that leaves the decoder lost (a varint running past three
+// bytes, no tag) closes the segment.
+//------------------------------------------------------------------------------
+static uint16_t log_end(const uint8_t *s)
+{
+    uint16_t pos = LOG_HEADER;
+    uint8_t tag;
+    uint8_t varints;
+    uint8_t n;
+
+    while(pos < LOG_SEG_SIZE)
+    {
+        tag = s[pos];
+        if(tag == LOG_END)
+            return pos;
+        pos++;
+        varints = 0;
+        if(tag < 0x80)
+            ;
+        else if(tag < LOG_TAG_LONG)
+            pos++;
+        else if(tag == LOG_TAG_LONG)
+            varints = 2;
+        else if(tag == LOG_TAG_ABS)
+            varints = 3;
+        else if(tag == LOG_TAG_OFFSET)
+            pos += 2;
+        else
+            break;
+        for(; varints != 0; varints--)
+        {
+            for(n = 0; n < 3 && pos < LOG_SEG_SIZE && (s[pos++] & 0x80); n++)
+                ;
+            if(n == 3)
+                return LOG_SEG_SIZE;
+        }
+    }
+    return LOG_SEG_SIZE;
+}
+
+//------------------------------------------------------------------------------
+// Boot: the newest segment by seq, where its records end, and which
+// segments are blank.  Records go on after the last one, an absolute one
+// first, so a power cycle mid-ride does not cost a segment.  A segment with
+// neither a header nor all 0xFF (erase cut short) is erased before use.
+//------------------------------------------------------------------------------
+void log_init(void)
+{
+    const uint8_t *s;
+    uint8_t found = 0;
+    uint8_t seg;
+    uint16_t seq;
+    uint16_t i;
+
+    logErased = 0;
+    logSeg = LOG_SEGS - 1;                    // none: start at segment 0
+    for(seg = 0; seg < LOG_SEGS; seg++)
+    {
+        s = log_segment(seg);
+        if(log_valid(seg))
+        {
+            seq = s[2] | (uint16_t)s[3] << 8;
+            if(!found || (int16_t)(seq - logSeq) > 0)
+            {
+                logSeq = seq;
+                logSeg = seg;
+                found = 1;
+            }
+            continue;
+        }
+        for(i = 0; i < LOG_SEG_SIZE && s[i] == LOG_END; i++)
+            ;
+        if(i == LOG_SEG_SIZE)
+            logErased |= 1u << seg;
+    }
+    logPos = LOG_SEG_SIZE;                    // none: the first revolution opens one
+    if(found)
+    {
+        logSeq++;
+        logPos = log_end(log_segment(logSeg));
+    }
+    logFresh = 1;                             // ctf_time_stamp1 starts over
+    logIdle = LOG_IDLE_SLOTS;                 // still until the first revolution
+}
+
+
+//------------------------------------------------------------------------------
+// Record encoding
+//------------------------------------------------------------------------------
+static uint8_t log_varint(uint8_t *p, uint16_t v)
+{
+    uint8_t n = 0;
+
+    while(v >= 0x80)
+    {
+        p[n++] = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    p[n++] = (uint8_t)v;
+    return n;
+}
+
+static uint16_t log_zigzag(uint16_t d)
+{
+    return (d << 1) ^ (uint16_t)(0 - (d >> 15));
+}
+
+// Header of the segment after logSeg, if log_slot() has erased it
+static uint8_t log_open(void)
+{
+    uint8_t seg = log_next(logSeg);
+    uint8_t head[LOG_HEADER];
+
+    if(!(logErased & (1u << seg)))
+        return 0;
+    head[0] = LOG_MAGIC0;
+    head[1] = LOG_MAGIC1;
+    head[2] = (uint8_t)logSeq;
+    head[3] = (uint8_t)(logSeq >> 8);
+    hal_log_write((uint16_t)seg * LOG_SEG_SIZE, head, LOG_HEADER);
+
+    logErased &= ~(1u << seg);
+    logSeg = seg;
+    logPos = LOG_HEADER;
+    logSeq++;
+    logFresh = 1;                             // decodes without the segment before
+    return 1;
+}
+
+//------------------------------------------------------------------------------
+// One revolution, from srm_revolution(): the accumulated values page 0x20
+// carries.  A few bytes to flash, never an erase.
+//------------------------------------------------------------------------------
+void log_revolution(uint16_t timeStamp, uint16_t torqueTicks)
+{
+    uint8_t rec[LOG_REC_MAX];
+    uint8_t n = 0;
+    uint16_t dt = timeStamp - logStamp;
+    uint16_t dk = torqueTicks - logTicks;
+    uint16_t t;
+    uint16_t k;
+
+    logStamp = timeStamp;
+    logTicks = torqueTicks;
+    logIdle = 0;
+    t = dt - logDt;                           // change from the revolution before
+    k = dk - logDk;
+    logDt = dt;                               // log_slot() times the erase by it
+    logDk = dk;
+
+    if(logPos > LOG_SEG_SIZE - LOG_REC_MAX && !log_open())
+    {
+        if(logGap != 0xFFFF)
+            logGap++;
+        if(logDropped != 0xFFFF)
+            logDropped++;
+        return;                               // no erased segment yet
+    }
+
+    if(logFresh || zeroOffset != logOffset)
+    {
+        rec[n++] = LOG_TAG_OFFSET;
+        rec[n++] = (uint8_t)zeroOffset;
+        rec[n++] = (uint8_t)(zeroOffset >> 8);
+        logOffset = zeroOffset;
+    }
+    if(logFresh)
+    {
+        rec[n++] = LOG_TAG_ABS;
+        n += log_varint(&rec[n], logGap);
+        n += log_varint(&rec[n], dt);
+        n += log_varint(&rec[n], dk);
+        logGap = 0;
+        logFresh = 0;
+    }
+    else
+    {
+        if((uint16_t)(t + 4) < 8 && (uint16_t)(k + 8) < 16)
+            rec[n++] = (uint8_t)((t & 0x07) << 4 | (k & 0x0F));
+        else if((uint16_t)(t + 32) < 64 && (uint16_t)(k + 128) < 256)
+        {
+            rec[n++] = 0x80 | (uint8_t)(t & 0x3F);
+            rec[n++] = (uint8_t)k;
+        }
+        else
+        {
+            rec[n++] = LOG_TAG_LONG;
+            n += log_varint(&rec[n], log_zigzag(t));
+            n += log_varint(&rec[n], log_zigzag(k));
+        }
+    }
+
+    hal_log_write((uint16_t)logSeg * LOG_SEG_SIZE + logPos, rec, n);
+    logPos += n;
+    logRecords++;
+}
+
+//------------------------------------------------------------------------------
+// Channel slot, before the page is queued: erase the next segment ahead of
+// the writer that is not blank yet, one per slot, in CTMMODE with the UART
+// idle.  With the cranks still any slot will do.  Pedalling, only the first
+// slot after a revolution, and only while that is less than half the last
+// revolution minus LOG_ERASE_ROOM ago: the cadence marker is then well
+// clear of the stall, which costs carrier heads only, and srm_stall()
+// counts those in.  Not in OFFSETMODE: the stall would cost the
+// calibration torque ticket heads.
+//------------------------------------------------------------------------------
+void log_slot(void)
+{
+    uint8_t seg = logSeg;
+    uint8_t idle = logIdle;
+    uint8_t i;
+    uint16_t since;
+
+    if(logIdle < LOG_IDLE_SLOTS)
+        logIdle++;
+    if(logDownload || unqomode != CTMMODE || (lpmClaims & LPM_UART_TX))
+        return;
+    if(idle == 0)
+    {
+        since = hal_timer1_now() - (uint16_t)old_transmit_timer;   // ~1/2048 s
+        if(logDt >= LOG_ERASE_DT_MAX || (since >> 1) + LOG_ERASE_ROOM >= logDt >> 1)
+            return;
+    }
+    else if(idle < LOG_IDLE_SLOTS)
+        return;
+
+    for(i = 0; i < LOG_AHEAD; i++)
+    {
+        seg = log_next(seg);
+        if(!(logErased & (1u << seg)))
+        {
+            srm_capture_drain();              // edges so far decode as usual
+            since = hal_timer1_now();
+            hal_log_erase((uint16_t)seg * LOG_SEG_SIZE);
+            srm_stall(hal_timer1_now() - since);
+            logErased |= 1u << seg;
+            return;
+        }
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Bulk download: txNextByte() asks for the next byte whenever the TX queue
+// is empty, so the UART ISR chains the blocks without the main loop.
+//------------------------------------------------------------------------------
+void log_download_start(void)
+{
+    dlSeg = log_next(logSeg);                 // oldest first
+    dlLeft = LOG_SEGS;
+    dlPos = 0;
+    dlBlock = 0;
+    dlStep = DL_SYNC0;
+    logDownload = 1;
+    UART_tx_start();
+}
+
+static uint8_t dl_crc(uint8_t b)
+{
+    dlCrc = (dlCrc << 4) ^ crcNibble[(dlCrc >> 12) ^ (b >> 4)];
+    dlCrc = (dlCrc << 4) ^ crcNibble[(dlCrc >> 12) ^ (b & 0x0F)];
+    return b;
+}
+
+int log_download_byte(void)
+{
+    switch(dlStep)
+    {
+    case DL_SYNC0:                            // next block: skip blank and sent segments
+        while(dlLeft != 0 && (dlPos == LOG_SEG_SIZE || !log_valid(dlSeg)))
+        {
+            dlSeg = log_next(dlSeg);
+            dlPos = 0;
+            dlLeft--;
+        }
+        dlLen = dlLeft != 0 ? LOG_DL_BLOCK : 0;   // divides LOG_SEG_SIZE
+        dlCrc = 0xFFFF;
+        dlStep = DL_SYNC1;
+        return LOG_DL_SYNC0;
+    case DL_SYNC1:
+        dlStep = DL_BLOCK_LO;
+        return LOG_DL_SYNC1;
+    case DL_BLOCK_LO:
+        dlStep = DL_BLOCK_HI;
+        return dl_crc((uint8_t)dlBlock);
+    case DL_BLOCK_HI:
+        dlStep = DL_LEN;
+        return dl_crc((uint8_t)(dlBlock >> 8));
+    case DL_LEN:
+        dlSent = 0;
+        dlStep = dlLen != 0 ? DL_DATA : DL_CRC_LO;
+        return dl_crc(dlLen);
+    case DL_DATA:
+        if(++dlSent == dlLen)
+            dlStep = DL_CRC_LO;
+        return dl_crc(log_segment(dlSeg)[dlPos++]);
+    case DL_CRC_LO:
+        dlStep = DL_CRC_HI;
+        return (uint8_t)dlCrc;
+    default:
+        dlStep = DL_SYNC0;
+        dlBlock++;
+        if(dlLen == 0)
+            logDownload = 0;                  // end block out: txNextByte() stops
+        return (uint8_t)(dlCrc >> 8);
+    }
+}
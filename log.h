@@ -0,0 +1,84 @@
+//******************************************************************************
+//  log.h - per-revolution ride log in main flash
+//
+//  Every revolution appends one record to a ring of 512 byte main flash
+//  segments (hal.h: HAL_LOG_BASE, HAL_LOG_SIZE): the time stamp delta
+//  (1/2000 s), the torque tick delta and, when it changes, the zero offset
+//  in use.  When a head unit loses the ANT link the ride is still on the
+//  converter and can be pulled afterwards.
+//
+//  Segment:  'R' 'L' seq(LE16)  records...  0xFF (erased) after the last
+//  Records hold the change of each delta from the revolution before, which
+//  at a steady cadence and torque is a few units:
+//      0ttt kkkk                  t -4..3, k -8..7
+//      10tt tttt  kkkk kkkk       t -32..31, k -128..127
+//      1100 0000  t  k            zigzag varints, any change
+//      1100 0001  n  dt  dk       varints: the deltas themselves, after n
+//                                 revolutions that were not logged
+//      1100 0010  offset(LE16)    zero offset, Hz
+//  A varint is 7 bits a byte, low bits first, bit 7 set on all but the
+//  last.  No tag is 0xFF, so the first 0xFF where a tag is due ends the
+//  segment.  Each segment opens with the offset and an absolute record and
+//  decodes on its own, so the ring can drop its oldest segment.
+//
+//  The pulse path never waits for flash: a record is one to a few bytes,
+//  each programmed with interrupts on in between (~75 us CPU stall each).
+//  Erasing stalls the CPU ~15 ms, so log_slot() keeps LOG_AHEAD segments
+//  erased ahead of the writer and picks its moment: any slot with the
+//  cranks still, and while pedalling the slot right after a revolution,
+//  when the next cadence marker is due long after the stall.  The carrier
+//  heads the stall swallows are added to the revolution gate from the
+//  carrier period (srm_stall()).  If the writer still runs into an unerased
+//  segment, revolutions are counted as dropped until it is erased.  The
+//  ring turns a segment at a time, so every segment is erased once per lap.
+//  At boot the writer carries on after the last record of the newest
+//  segment.
+//
+//  Holding P1.3 down at power-up sends the log over the ANT link UART
+//  before the AP1 is configured, back to back at the link rate:
+//      0x5A 0xA5 block(LE16) len data[len] crc(LE16)
+//  block counts from 0, data is the valid segments oldest first, LOG_DL_BLOCK
+//  bytes a block, and the CRC-16/CCITT (0x1021, init 0xFFFF) covers block,
+//  len and data.  A block with len 0 ends the download.  host/logdump.c
+//  turns a capture of it into CSV.
+//******************************************************************************
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+#define LOG_SEG_SIZE        512               // main flash segment
+#define LOG_SEGS            (HAL_LOG_SIZE / LOG_SEG_SIZE)
+#define LOG_AHEAD           2                 // segments kept erased ahead
+#define LOG_IDLE_SLOTS      12                // ~3 s without a revolution: still
+#define LOG_ERASE_ROOM      40                // 1/2000 s: the erase stall, and spare
+#define LOG_ERASE_DT_MAX    6000              // 1/2000 s: longer revolutions give no cadence
+
+#define LOG_MAGIC0          0x52              // 'R'
+#define LOG_MAGIC1          0x4C              // 'L'
+#define LOG_HEADER          4                 // magic, seq
+
+#define LOG_TAG_LONG        0xC0
+#define LOG_TAG_ABS         0xC1
+#define LOG_TAG_OFFSET      0xC2
+#define LOG_END             0xFF
+
+#define LOG_DL_SYNC0        0x5A
+#define LOG_DL_SYNC1        0xA5
+#define LOG_DL_BLOCK        64                // data bytes per download block
+
+extern uint16_t logErased;                    // bit n: segment n is blank
+extern uint16_t logRecords;                   // logged since boot
+extern uint16_t logDropped;                   // revolutions not logged since boot
+extern volatile uint8_t logDownload;          // download running
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+void log_init(void);                          // boot: find the newest segment, its end
+void log_revolution(uint16_t timeStamp, uint16_t torqueTicks);
+void log_slot(void);                          // erase ahead of the writer
+void log_download_start(void);
+int  log_download_byte(void);                 // UART ISR: next byte, -1 at the end
+
+#endif // LOG_H
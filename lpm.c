@@ -0,0 +1,93 @@
+//******************************************************************************
+//  lpm.c - power-state manager, idle policy
+//******************************************************************************
+
+#include "hal.h"
+#include "lpm.h"
+#include "srm.h"
+#include "ant.h"
+
+#if LPM_IDLE_SLOTS <= 66
+#error "LPM_IDLE_SLOTS must span a Timer1_A wrap (16 s) for LPM4"
+#endif
+#if LPM_IDLE_DIV < 1 || LPM_IDLE_DIV > 8
+#error "LPM_IDLE_DIV must be 1..8: slotFraction is 16 bit unsigned"
+#endif
+#if LPM_IDLE_SLOTS + LPM_IDLE_DIV > 0xFF || LPM_QUIET_SLOTS + LPM_IDLE_DIV > 0xFF \
+    || LPM_SYNC_SLOTS + LPM_IDLE_DIV > 0xFF
+#error "the slot counts are 8 bit"
+#endif
+
+volatile uint8_t lpmClaims;
+volatile uint8_t lpmSlotDiv = 1;
+uint8_t lpmEdges;
+
+static uint8_t  lpmIdle;                      // channel periods without a revolution
+static uint8_t  lpmQuiet;                     // channel periods without a torque edge
+static uint8_t  lpmRevs;                      // srmRevolutions at the last slot, low byte
+#ifndef UART_USCI_A0
+static uint8_t  lpmSyncAge = LPM_SYNC_SLOTS;  // channel periods since an EVENT_TX window
+#endif
+
+
+// Slot period in channel periods; the AP1 broadcasts at the same period
+static void lpm_div(uint8_t div)
+{
+    if(div == lpmSlotDiv)
+        return;
+    lpmSlotDiv = div;
+    antSetPeriod(div);
+}
+
+//------------------------------------------------------------------------------
+// Once a slot, after the page went out.  The counts run in channel periods,
+// so they keep time while the slots are LPM_IDLE_DIV periods apart.
+//------------------------------------------------------------------------------
+void lpm_slot(void)
+{
+    uint8_t step = lpmSlotDiv;
+
+    if((uint8_t)srmRevolutions != lpmRevs || unqomode != CTMMODE)
+    {
+        lpmRevs = (uint8_t)srmRevolutions;
+        lpmIdle = 0;
+    }
+    else if(lpmIdle < LPM_IDLE_SLOTS)
+        lpmIdle += step;
+
+    if(lpmEdges)
+    {
+        lpmEdges = 0;
+#ifndef UART_USCI_A0
+        if(lpmQuiet >= LPM_QUIET_SLOTS)       // back from LPM4: Timer1_A stood still
+            lpmSyncAge = LPM_SYNC_SLOTS;
+#endif
+        lpmQuiet = 0;
+    }
+    else if(lpmQuiet < LPM_QUIET_SLOTS)
+        lpmQuiet += step;
+
+#ifndef UART_USCI_A0
+    if(lpmClaims & LPM_ANT_SYNC)              // a whole period and no EVENT_TX
+        lpm_release(LPM_ANT_SYNC);
+    else if(lpmSyncAge < LPM_SYNC_SLOTS)
+        lpmSyncAge += step;
+    else
+    {
+        lpmSyncAge = 0;
+        lpm_claim(LPM_ANT_SYNC);              // listen until the next slot
+    }
+#endif
+
+    if(lpmIdle < LPM_IDLE_SLOTS)
+    {
+        lpm_div(1);                           // pedalling, or OFFSETMODE
+        lpm_claim(LPM_SLOT);
+        return;
+    }
+    lpm_div(LPM_IDLE_DIV);
+    if(lpmQuiet >= LPM_QUIET_SLOTS)
+        lpm_release(LPM_SLOT | LPM_CAPTURE);  // LPM4 until P2.2 or P1.3
+    else
+        lpm_claim(LPM_SLOT);                  // torque line back, cranks still
+}
@@ -0,0 +1,118 @@
+//******************************************************************************
+//  lpm.h - power-state manager: the deepest low-power mode the clocks still
+//  in use allow
+//
+//  Each user below claims its bit while it needs its clock and releases it
+//  after, from the main loop or from a vector.  When the main loop runs out
+//  of events it sleeps in the mode lpm_mode() picks:
+//      an SMCLK user claimed     LPM0   DCO on, SMCLK for the UART
+//      an ACLK user claimed      LPM3   ACLK only, Timer1_A and WDT run
+//      nothing                   LPM4   all clocks off, port edges wake
+//  Adding a user is one bit here, in LPM_NEED_SMCLK or LPM_NEED_ACLK.
+//
+//  Once a slot, lpm_slot() looks at the pedalling:
+//    - no revolution for LPM_IDLE_SLOTS channel periods: the slot timer
+//      runs LPM_IDLE_DIV periods apart, and the AP1 is set to broadcast at
+//      that period too (antSetPeriod()); a head unit at the ANT+ period
+//      hears every LPM_IDLE_DIV-th of its slots and stays paired.  The
+//      next revolution restores full rate on both.
+//    - and no torque edge for LPM_QUIET_SLOTS periods either (SRM asleep
+//      or unplugged): capture and the slot timer are released.  Nothing
+//      else claimed, the main loop arms P2.2 as a port interrupt and sleeps
+//      in LPM4; the first edge on the torque line restores the capture and
+//      the slots.  Timer1_A stands still meanwhile, so LPM_IDLE_SLOTS spans
+//      more than a Timer1 wrap and the first revolution after is gated
+//      like any after a long stop.
+//  OFFSETMODE always runs at full rate.
+//
+//  The slots follow the AP1's EVENT_TX on the power channel (ant.c).  The
+//  Timer_A UART needs SMCLK to see a start bit, so in that build lpm_slot()
+//  keeps LPM0 for one slot after boot, after LPM4 and every LPM_SYNC_SLOTS
+//  periods (LPM_ANT_SYNC), until an EVENT_TX has come in.  Two crystals
+//  drift a few ms a minute at most, against a 250 ms period.
+//******************************************************************************
+#ifndef LPM_H
+#define LPM_H
+
+#include <stdint.h>
+#include "hal.h"
+
+// Users, one bit each
+#define LPM_UART_TX         0x01              // SMCLK: frame on the ANT link
+#define LPM_UART_RX         0x02              // SMCLK: Timer_A UART start bit capture
+#define LPM_CAPTURE         0x04              // ACLK: Timer1_A latches torque edges
+#define LPM_SLOT            0x08              // ACLK: Timer1_A CCR2 channel slots
+#define LPM_CAL             0x10              // ACLK: Timer1_A CCR0 OFFSETMODE tick
+#define LPM_DEBOUNCE        0x20              // ACLK: WDT interval timer, P1.3
+#define LPM_ANT_SYNC        0x40              // SMCLK: Timer_A UART waits for an EVENT_TX
+
+#define LPM_NEED_SMCLK      (LPM_UART_TX | LPM_UART_RX | LPM_ANT_SYNC)
+#define LPM_NEED_ACLK       (LPM_CAPTURE | LPM_SLOT | LPM_CAL | LPM_DEBOUNCE)
+
+enum{
+    LPM_SLEEP0 = 0,
+    LPM_SLEEP3,
+    LPM_SLEEP4
+};
+
+// Idle policy, in ANT channel periods (~4 Hz)
+#ifndef LPM_IDLE_SLOTS
+#define LPM_IDLE_SLOTS      240               // ~60 s without a revolution
+#endif
+#ifndef LPM_IDLE_DIV
+#define LPM_IDLE_DIV        4                 // slots ~1 s apart while idle
+#endif
+#ifndef LPM_QUIET_SLOTS
+#define LPM_QUIET_SLOTS     40                // ~10 s without a torque edge
+#endif
+#ifndef LPM_SYNC_SLOTS
+#define LPM_SYNC_SLOTS      240               // ~60 s between EVENT_TX windows
+#endif
+
+extern volatile uint8_t lpmClaims;            // LPM_ users claimed now
+extern volatile uint8_t lpmSlotDiv;           // channel periods per slot
+extern uint8_t lpmEdges;                      // torque edges since the last slot
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+void lpm_slot(void);                          // idle policy, once a slot
+
+//------------------------------------------------------------------------------
+// Claims: safe from the main loop and from the vectors
+//------------------------------------------------------------------------------
+static inline void lpm_claim(uint8_t users)
+{
+    hal_istate_t state = hal_irq_save();
+
+    lpmClaims |= users;
+    hal_irq_restore(state);
+}
+
+static inline void lpm_release(uint8_t users)
+{
+    hal_istate_t state = hal_irq_save();
+
+    lpmClaims &= ~users;
+    hal_irq_restore(state);
+}
+
+// Main loop, interrupts off, nothing left to do
+static inline uint8_t lpm_mode(void)
+{
+    if(lpmClaims & LPM_NEED_SMCLK)
+        return LPM_SLEEP0;
+    if(lpmClaims & LPM_NEED_ACLK)
+        return LPM_SLEEP3;
+    return LPM_SLEEP4;
+}
+
+// srm_capture_drain(): the torque line is alive
+static inline void lpm_edge(void)
+{
+    lpmEdges = 1;
+    if(!(lpmClaims & LPM_CAPTURE))
+        lpm_claim(LPM_CAPTURE);
+}
+
+#endif // LPM_H
@@ -0,0 +1,261 @@
+//******************************************************************************
+//  power.c - cadence and power from the CTF revolutions, page 0x10/0x12 values
+//
+//  The G2553 has no hardware multiplier, so a 32/16 divide costs several
+//  hundred cycles in the compiler's runtime.  Nothing here divides on the
+//  revolution path: the crank period goes through a reciprocal table, the
+//  remaining products are 16x16 shift-add multiplies and constant factors
+//  are open-coded shifts.  One revolution costs three multiplies of at most
+//  16 rounds each plus a table lookup, under 1000 MCLK cycles (1 ms) for
+//  any input.
+//
+//  Per revolution, period P in Timer1 ticks (4096 Hz) and r = 2^26 / P:
+//      cadence  rpm    = 60 * 4096 / P            = 15 * r / 2^12
+//      torque   Hz     = ticks * 4096 / P
+//      torque   Nm     = 10 * (Hz - offset) / slope, 0 until calibrated
+//      omega    rad/s  = 2 pi * 4096 / P          = 804.25 * r / 2^21
+//      power    W      = Nm * omega
+//
+//  Page 0x12 takes the same revolutions: the accumulated period is the
+//  revolution time itself (old_transmit_timer, srm.c) halved to 1/2048 s,
+//  so a glitch that is not counted as an event still ends up in the next
+//  period; the accumulated torque adds up the 1/256 Nm torques rounded to
+//  1/32 Nm.
+//
+//  The 3 s and 10 s averages are running sums over a ring of per-second
+//  sums of the slot samples (10 words of RAM rather than 40): one add and
+//  one subtract per window per second.
+//******************************************************************************
+
+#include "hal.h"
+#include "srm.h"
+#include "cal.h"
+#include "power.h"
+#include "snap.h"
+
+uint8_t  powerEvent;
+uint8_t  powerCadence = 0xFF;
+uint16_t powerWatts;
+uint16_t powerAccWatts;
+uint16_t powerAccTorque;
+uint16_t powerAvg3;
+uint16_t powerAvg10;
+
+static uint16_t powerSlope;                   // ctfSlope powerSlopeRecip is for
+static uint16_t powerSlopeRecip;              // 10 * 2^16 / slope
+static uint8_t  powerSinceRev;                // slots since the last revolution
+
+static uint16_t powerRing[POWER_AVG10_SECONDS];  // W summed per second, last 10 s
+static uint8_t  powerPos;                     // oldest second, next to overwrite
+static uint16_t powerSecond;                  // W summed over this second so far
+static uint8_t  powerSecondSlots;             // slots in powerSecond
+static uint16_t powerSum3;
+static uint32_t powerSum10;
+
+static volatile powerSnap_t powerSnap[2] = {  // published page 0x10/0x12 values
+    { 0, 0, 0, 0, 0, 0xFF }, { 0, 0, 0, 0, 0, 0xFF }
+};
+static volatile uint8_t powerSnapSeq;
+
+//------------------------------------------------------------------------------
+// round(2^24 / m) for m = 256..511 (m = 256 clamped to 16 bits)
+//------------------------------------------------------------------------------
+static const uint16_t powerRecipTable[256] = {
+    65535, 65281, 65028, 64777, 64528, 64281, 64035, 63792,
+    63550, 63310, 63072, 62836, 62602, 62369, 62138, 61909,
+    61681, 61455, 61231, 61008, 60787, 60568, 60350, 60133,
+    59919, 59705, 59494, 59283, 59075, 58867, 58662, 58457,
+    58254, 58053, 57852, 57654, 57456, 57260, 57065, 56872,
+    56680, 56489, 56299, 56111, 55924, 55738, 55554, 55370,
+    55188, 55007, 54828, 54649, 54471, 54295, 54120, 53946,
+    53773, 53601, 53431, 53261, 53092, 52925, 52759, 52593,
+    52429, 52265, 52103, 51942, 51782, 51622, 51464, 51306,
+    51150, 50995, 50840, 50686, 50534, 50382, 50231, 50081,
+    49932, 49784, 49637, 49490, 49345, 49200, 49056, 48913,
+    48771, 48630, 48489, 48349, 48210, 48072, 47935, 47798,
+    47663, 47528, 47393, 47260, 47127, 46995, 46864, 46733,
+    46603, 46474, 46346, 46218, 46091, 45965, 45839, 45714,
+    45590, 45467, 45344, 45222, 45100, 44979, 44859, 44739,
+    44620, 44502, 44384, 44267, 44151, 44035, 43919, 43805,
+    43691, 43577, 43464, 43352, 43240, 43129, 43019, 42908,
+    42799, 42690, 42582, 42474, 42367, 42260, 42154, 42048,
+    41943, 41838, 41734, 41631, 41528, 41425, 41323, 41222,
+    41121, 41020, 40920, 40820, 40721, 40623, 40525, 40427,
+    40330, 40233, 40137, 40041, 39946, 39851, 39756, 39662,
+    39569, 39476, 39383, 39291, 39199, 39108, 39017, 38926,
+    38836, 38746, 38657, 38568, 38480, 38392, 38304, 38217,
+    38130, 38044, 37958, 37872, 37787, 37702, 37617, 37533,
+    37449, 37366, 37283, 37200, 37118, 37036, 36954, 36873,
+    36792, 36712, 36631, 36552, 36472, 36393, 36314, 36236,
+    36158, 36080, 36003, 35926, 35849, 35772, 35696, 35620,
+    35545, 35470, 35395, 35320, 35246, 35172, 35099, 35026,
+    34953, 34880, 34808, 34735, 34664, 34592, 34521, 34450,
+    34380, 34309, 34239, 34169, 34100, 34031, 33962, 33893,
+    33825, 33757, 33689, 33622, 33554, 33487, 33421, 33354,
+    33288, 33222, 33157, 33091, 33026, 32961, 32897, 32832,
+};
+
+
+//------------------------------------------------------------------------------
+// a * b, shift-add.  The loop runs once per significant bit of b.
+//------------------------------------------------------------------------------
+uint32_t power_mul16(uint16_t a, uint16_t b)
+{
+    uint32_t acc = 0;
+    uint32_t addend = a;
+
+    while(b)
+    {
+        if(b & 1)
+            acc += addend;
+        addend <<= 1;
+        b >>= 1;
+    }
+    return acc;
+}
+
+
+//------------------------------------------------------------------------------
+// 2^26 / period for period >= POWER_PERIOD_MIN, within 0.25%.
+//
+// The period is rounded to a 9 bit mantissa m * 2^e (e >= 2 in range), so
+// 2^26 / period = (2^24 / m) >> (e - 2).
+//------------------------------------------------------------------------------
+uint16_t power_recip(uint16_t period)
+{
+    uint8_t e = 2;
+    uint16_t m;
+
+    if(period < POWER_PERIOD_MIN)
+        return 0xFFFF;
+    while((period >> e) >= 0x0200)
+        e++;
+    m = ((period >> (e - 1)) + 1) >> 1;                  // rounded mantissa
+    if(m == 0x0200)
+    {
+        m = 0x0100;
+        e++;
+    }
+    return powerRecipTable[m - 0x0100] >> (e - 2);
+}
+
+
+//------------------------------------------------------------------------------
+// Page 0x10/0x12 values as one set: event count and accumulated values must match
+//------------------------------------------------------------------------------
+static void power_publish(void)
+{
+    volatile powerSnap_t *s = SNAP_NEXT(powerSnap, powerSnapSeq);
+
+    s->watts     = powerWatts;
+    s->accWatts  = powerAccWatts;
+    s->accPeriod = (uint16_t)(old_transmit_timer >> 1);
+    s->accTorque = powerAccTorque;
+    s->event     = powerEvent;
+    s->cadence   = powerCadence;
+    SNAP_PUBLISH(powerSnapSeq);
+}
+
+void power_snapshot(powerSnap_t *snap)
+{
+    snap_read(snap, powerSnap, sizeof(*snap), &powerSnapSeq);
+}
+
+
+//------------------------------------------------------------------------------
+// One crank revolution: period in Timer1 ticks, torque ticks in 1/256.
+// old_transmit_timer already holds the time of this one.
+//------------------------------------------------------------------------------
+void power_revolution(uint16_t period, uint32_t ticks)
+{
+    uint16_t r;
+    uint16_t ticks16;
+    uint32_t hz;                                         // 1/16 Hz
+    uint16_t offset;
+    uint16_t net;
+    uint32_t torque;                                     // 1/256 Nm
+    uint16_t omega;                                      // 1/256 rad/s
+    uint32_t watts;
+
+    if(period < POWER_PERIOD_MIN)
+        return;
+
+    if(ctfSlope != powerSlope)                           // only after a slope change
+    {
+        powerSlope = ctfSlope;
+        powerSlopeRecip = powerSlope > 10 ? (uint16_t)(655360UL / powerSlope) : 0xFFFF;
+    }
+
+    r = power_recip(period);
+
+    // cadence: 15 * r / 2^12, rounded
+    powerCadence = (uint8_t)(((((uint32_t)r << 4) - r) + 0x0800) >> 12);
+
+    // torque frequency in 1/16 Hz: ticks/16 * r / 2^14
+    ticks16 = ticks >= 0x000FFFF8UL ? 0xFFFF : (uint16_t)((ticks + 8) >> 4);
+    hz = power_mul16(ticks16, r) >> 14;
+    offset = zeroOffset < 0x1000 ? (uint16_t)(zeroOffset << 4) : 0xFFFF;
+    if(zeroOffset == 0)                                  // not calibrated: without the
+        offset = 0xFFFF;                                 // offset there is no torque, 0 W
+    if(hz > 0xFFFF)
+        hz = 0xFFFF;
+    net = (uint16_t)hz > offset ? (uint16_t)hz - offset : 0;
+
+    // torque in 1/256 Nm (up to 256 Nm), omega in 1/256 rad/s:
+    // r * (512+256+32+4) / 2^13
+    torque = (power_mul16(net, powerSlopeRecip) + 0x0800) >> 12;
+    if(torque > 0xFFFF)
+        torque = 0xFFFF;
+    omega = (uint16_t)((((uint32_t)r << 9) + ((uint32_t)r << 8)
+                      + ((uint32_t)r << 5) + ((uint32_t)r << 2)) >> 13);
+
+    watts = (power_mul16((uint16_t)torque, omega) + 0x8000) >> 16;
+    if(watts > POWER_WATTS_MAX)
+        watts = POWER_WATTS_MAX;
+
+    powerWatts = (uint16_t)watts;
+    powerAccWatts += (uint16_t)watts;
+    powerAccTorque += (uint16_t)((torque + 4) >> 3);
+    powerEvent++;
+    powerSinceRev = 0;
+    power_publish();
+}
+
+
+//------------------------------------------------------------------------------
+// Channel period slot (EV_SLOT): stop detection and the rolling averages
+//------------------------------------------------------------------------------
+void power_slot(void)
+{
+    uint16_t in;
+    uint8_t old3;
+
+    if(powerSinceRev < POWER_STOP_SLOTS)
+        powerSinceRev++;
+    else if(powerCadence != 0xFF)                        // cranks stopped
+    {
+        powerCadence = 0;
+        powerWatts = 0;
+        power_publish();
+    }
+
+    powerSecond += powerWatts;                           // 4 * 4095 W fits 16 bits
+    if(++powerSecondSlots < POWER_SECOND_SLOTS)
+        return;
+    powerSecondSlots = 0;
+
+    in = powerSecond;
+    powerSecond = 0;
+    old3 = powerPos >= POWER_AVG3_SECONDS ? powerPos - POWER_AVG3_SECONDS
+                                          : powerPos + (POWER_AVG10_SECONDS - POWER_AVG3_SECONDS);
+    powerSum3 += in - powerRing[old3];
+    powerSum10 += in;
+    powerSum10 -= powerRing[powerPos];
+    powerRing[powerPos] = in;
+    if(++powerPos >= POWER_AVG10_SECONDS)
+        powerPos = 0;
+
+    // 12 and 40 slots: sum3 / 12 and sum10 / 40 = (sum10 / 8) / 5, by reciprocal
+    powerAvg3 = (uint16_t)(power_mul16(powerSum3, 5462) >> 16);
+    powerAvg10 = (uint16_t)(power_mul16((uint16_t)(powerSum10 >> 3), 13108) >> 16);
+}
@@ -0,0 +1,43 @@
+//******************************************************************************
+//  power.h - cadence and power from the CTF revolutions, page 0x10/0x12 values
+//******************************************************************************
+#ifndef POWER_H
+#define POWER_H
+
+#include <stdint.h>
+
+#define POWER_PERIOD_MIN    1024              // Timer1 ticks, 240 rpm, shorter is a glitch
+#define POWER_WATTS_MAX     4095              // clamp, keeps the window sums small
+#define POWER_STOP_SLOTS    12                // ~3 s without a revolution: 0 rpm, 0 W
+#define POWER_SECOND_SLOTS  4                 // channel period slots per ~1 s sum
+#define POWER_AVG3_SECONDS  3
+#define POWER_AVG10_SECONDS 10                // ring size
+
+extern uint8_t  powerEvent;                   // page 0x10 event count
+extern uint8_t  powerCadence;                 // rpm, 0xFF before the first revolution
+extern uint16_t powerWatts;                   // instantaneous, W
+extern uint16_t powerAccWatts;                // accumulated, W, wraps
+extern uint16_t powerAccTorque;               // accumulated, 1/32 Nm, wraps
+extern uint16_t powerAvg3;                    // W, rolling 3 s, moves once a second
+extern uint16_t powerAvg10;                   // W, rolling 10 s, moves once a second
+
+// Page 0x10 and 0x12 values, published as one set (snap.h)
+typedef struct {
+    uint16_t watts;                           // powerWatts
+    uint16_t accWatts;                        // powerAccWatts
+    uint16_t accPeriod;                       // old_transmit_timer, 1/2048 s
+    uint16_t accTorque;                       // powerAccTorque
+    uint8_t  event;                           // powerEvent
+    uint8_t  cadence;                         // powerCadence
+} powerSnap_t;
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+void power_snapshot(powerSnap_t *snap);
+uint32_t power_mul16(uint16_t a, uint16_t b);
+uint16_t power_recip(uint16_t period);
+void power_revolution(uint16_t period, uint32_t ticks);
+void power_slot(void);
+
+#endif // POWER_H
@@ -0,0 +1,13 @@
+//******************************************************************************
+//  prof.c - ISR latency and execution time histograms (ISR_PROFILE builds)
+//******************************************************************************
+
+#include "hal.h"
+#include "prof.h"
+
+#ifdef ISR_PROFILE
+
+uint8_t  profHist[PROF_ISRS][PROF_KINDS][PROF_BUCKETS];
+uint16_t profMax[PROF_ISRS];
+
+#endif
@@ -0,0 +1,79 @@
+//******************************************************************************
+//  prof.h - ISR latency and execution time histograms (ISR_PROFILE builds)
+//
+//  Each instrumented vector reads the free running Timer_A count (TAR,
+//  SMCLK, 1 us) on entry and again on exit, and files the difference in a
+//  log2 histogram.  Vectors with a hardware time stamp for the event that
+//  raised them (a capture or the compare value) also file how late they
+//  started, in that timer's units: Timer_A vectors in us, Timer1_A vectors
+//  in Timer1 ticks (244 us, TA1R is read asynchronously, +-1).  The
+//  histograms go out in ANT page 0xF0 (ant.c).
+//
+//  Buckets are saturating byte counters; the last one takes everything
+//  from 64 up, and profMax keeps how long the longest run of each vector
+//  was, so an outlier is not lost in it.  72 bytes of RAM for the four
+//  vectors, which the profile build finds by leaving out the energy
+//  account (energy.h).  Without ISR_PROFILE every macro below is empty and
+//  nothing is linked in.  With it, ~30 cycles per interrupt.
+//******************************************************************************
+#ifndef PROF_H
+#define PROF_H
+
+#include <stdint.h>
+
+//#define ISR_PROFILE
+
+enum{
+    PROF_TIMER1_A1 = 0,                       // torque capture, channel slot
+    PROF_TIMER1_A0,                           // OFFSETMODE tick
+    PROF_UART_TX,                             // Timer_A0_ISR or USCI0TX_ISR
+    PROF_UART_RX,                             // Timer_A1_ISR or USCI0RX_ISR
+    PROF_ISRS
+};
+
+#ifdef ISR_PROFILE
+
+#define PROF_BUCKETS        8                 // 0, 1, 2-3, 4-7 .. 32-63, 64 and up
+
+enum{
+    PROF_LATENCY = 0,
+    PROF_EXEC,
+    PROF_KINDS
+};
+
+extern uint8_t  profHist[PROF_ISRS][PROF_KINDS][PROF_BUCKETS];
+extern uint16_t profMax[PROF_ISRS];           // longest run time, us
+
+static inline void prof_record(uint8_t *hist, uint16_t value)
+{
+    uint8_t bucket = 0;
+
+    while(value && bucket < PROF_BUCKETS - 1)
+    {
+        value >>= 1;
+        bucket++;
+    }
+    if(hist[bucket] != 0xFF)
+        hist[bucket]++;
+}
+
+static inline void prof_exit(uint8_t isr, uint16_t exec)
+{
+    if(exec > profMax[isr])
+        profMax[isr] = exec;
+    prof_record(profHist[isr][PROF_EXEC], exec);
+}
+
+#define PROF_ENTER(isr)         uint16_t profEntry = hal_prof_now()
+#define PROF_LATENCY(isr,late)  prof_record(profHist[isr][PROF_LATENCY], (uint16_t)(late))
+#define PROF_EXIT(isr)          prof_exit(isr, (uint16_t)(hal_prof_now() - profEntry))
+
+#else
+
+#define PROF_ENTER(isr)
+#define PROF_LATENCY(isr,late)
+#define PROF_EXIT(isr)
+
+#endif // ISR_PROFILE
+
+#endif // PROF_H
@@ -0,0 +1,52 @@
+//******************************************************************************
+//  snap.h - sequence-counted double buffer for values that belong together
+//
+//  A page has to carry the event count, time stamp and torque ticks of one
+//  and the same revolution.  The producer keeps its working values to
+//  itself and, once a set is complete, publishes it: it fills the copy
+//  readers are not using, then bumps the sequence number, which makes that
+//  copy current.  It never waits and never holds interrupts off.  A reader
+//  copies the current set out and keeps it only if the sequence number has
+//  not moved meanwhile, otherwise it copies again; it can only be made to
+//  retry by a publish, and the retry then finds the set complete.
+//
+//  One producer per snapshot, in an ISR or in the main loop, and any number
+//  of readers anywhere: a reader in a vector reads the copy the interrupted
+//  producer is not filling, and the producer cannot publish under it.
+//
+//      static volatile thing_t thing[2];
+//      static volatile uint8_t thingSeq;
+//
+//      SNAP_NEXT(thing, thingSeq)->x = x;          // producer
+//      SNAP_PUBLISH(thingSeq);
+//
+//      snap_read(&copy, thing, sizeof(copy), &thingSeq);    // reader
+//******************************************************************************
+#ifndef SNAP_H
+#define SNAP_H
+
+#include <stdint.h>
+
+#define SNAP_NEXT(pair,seq)     (&(pair)[((seq) + 1) & 1])      // copy to fill
+#define SNAP_PUBLISH(seq)       ((seq)++)                       // make it current
+
+static inline void snap_read(void *dst, const volatile void *pair, uint8_t size,
+                             const volatile uint8_t *seq)
+{
+    const volatile uint8_t *src;
+    uint8_t *d;
+    uint8_t s;
+    uint8_t i;
+
+    do
+    {
+        s = *seq;
+        src = (const volatile uint8_t *)pair + (s & 1) * size;
+        d = (uint8_t *)dst;
+        for(i = 0; i < size; i++)
+            *d++ = *src++;
+    }
+    while(s != *seq);
+}
+
+#endif // SNAP_H
@@ -0,0 +1,374 @@
+//******************************************************************************
+//  srm.c - SRM torque pulse decoder and calibration state
+//
+//  Handlers for the events the Port_1, TIMER1_A0 and TIMER1_A1 vectors post
+//  (event.c), and the decode of the edges TIMER1_A1 captures.  The vectors in
+//  the main file only latch the hardware state, so the host simulation can
+//  drive the exact same decode path.
+//******************************************************************************
+
+#include "hal.h"
+#include "ant.h"
+#include "srm.h"
+#include "cal.h"
+#include "power.h"
+#include "snap.h"
+#include "log.h"
+#include "lpm.h"
+
+unsigned int new_timer=0;
+unsigned int old_timer=0;
+uint32_t old_transmit_timer=0;                // Last revolution, extended Timer1 time
+
+unsigned int PulseCount=0;
+
+unsigned int chatter_count13 = 0;
+
+uint16_t ctf_time_stamp1;                     // accumulated, 1/2000 s
+static uint8_t ctfTimeResidue;                // 1/256 of a ctf_time_stamp1 unit
+uint16_t ctf_torque_ticks1;
+uint16_t srmRevolutions;
+
+// Reciprocal counter over the current revolution gate
+uint16_t recipCount;                          // torque ticket heads in the gate
+uint16_t recipFirst;                          // time of the first head
+uint16_t recipLast;                           // time of the last head
+uint32_t torqueTicksAcc;                      // accumulated torque ticks, 1/256 units
+
+uint8_t srmDataSeq;                           // new revolution, cal tick or mode
+
+static volatile srmSnap_t srmSnap[2];         // published revolution values
+static volatile uint8_t srmSnapSeq;
+
+uint8_t  srmState = SRM_WAIT_HEAD;
+uint16_t srmCarrier = SRM_CARRIER_INIT;
+uint16_t srmGlitches;
+static uint16_t srmLastHead;                  // capture of the last bundle head
+static uint8_t  srmGlitchRun;                 // glitches since that head
+
+
+volatile uint16_t captureFifo[CAPTURE_FIFO_SIZE];
+volatile uint8_t captureHead;
+volatile uint8_t captureTail;
+uint16_t captureOverflow;
+uint16_t captureMissed;
+
+//int unqomode = CTMMODE;         // for mode changer 1=CTM mode 2=OFFSET mode
+int unqomode = CTMMODE;            // for mode changer 1=CTM mode 2=OFFSET mode, boot runs Timer1_A_period_init()
+
+
+int calc_time_diff(int end_t,int start_t)
+{
+	/*TAIFGtOgĂ񂾂ǁc*/
+
+    if(end_t >= start_t)
+        return((unsigned int)(end_t - start_t));
+    else	/* if timer return to 0 */
+        return((unsigned int)((0xffff - start_t) + 1 + end_t));
+}
+
+
+//------------------------------------------------------------------------------
+// Torque ticks in one revolution gate, in 1/256 ticks.
+//
+// Gated counting alone gives count +-1 per revolution.  Reciprocal counting
+// times count-1 whole torque cycles (first to last head, span) and scales
+// that frequency to the gate:
+//     (count-1) * gate / span = (count-1) + (count-1) * (gate-span) / span
+// Only the correction term needs a divide, a 16x16 multiply and one 32/16
+// divide per revolution, which the G2553 does in software.  Falls back to
+// the gated count when there are too few heads to time.
+//------------------------------------------------------------------------------
+uint32_t srm_recip_ticks(uint16_t count, uint16_t span, uint16_t gate)
+{
+    uint32_t cycles;
+    uint32_t corr;
+
+    if(count < 2 || span == 0 || gate < span)
+        return (uint32_t)count << 8;                     // gated count
+
+    cycles = count - 1;
+    corr = cycles * (uint16_t)(gate - span);             // < 2^24 unless the
+    if(corr >= 0x01000000UL)                             // gate is mostly idle
+        return (uint32_t)count << 8;
+
+    return (cycles << 8) + (corr << 8) / span;
+}
+
+
+//------------------------------------------------------------------------------
+// Capture -> extended Timer1 time.  A capture is decoded within a few ms, so
+// it lies less than one 16 s wrap behind the extended count now.
+//------------------------------------------------------------------------------
+static uint32_t srm_time_extend(uint16_t capture)
+{
+    uint32_t now = hal_timer1_now32();
+
+    return now - (uint16_t)((uint16_t)now - capture);
+}
+
+
+//------------------------------------------------------------------------------
+// Move the page 0x20 time stamp on by a number of Timer1 ticks.
+//
+// One 1/4096 s tick is exactly 125/256 of a 1/2000 s unit.  The whole
+// multiples of 256 ticks convert exactly, the rest goes through the
+// residue in 1/256 units that carries into the next revolution, so no
+// rounding error builds up however long the ride.  x * 125 is open-coded
+// as (x << 7) - (x << 1) - x; the stamp wraps at 16 bits like on the air.
+//------------------------------------------------------------------------------
+static void srm_time_stamp_advance(uint32_t ticks)
+{
+    uint16_t whole = (uint16_t)(ticks >> 8);
+    uint16_t part = (uint16_t)ticks & 0xFF;
+
+    part = (part << 7) - (part << 1) - part + ctfTimeResidue;    // < 2^15
+    ctf_time_stamp1 += (whole << 7) - (whole << 1) - whole + (part >> 8);
+    ctfTimeResidue = (uint8_t)part;
+}
+
+
+//------------------------------------------------------------------------------
+// Decode every captured edge, main loop only
+//------------------------------------------------------------------------------
+void srm_capture_drain(void)
+{
+    uint8_t tail = captureTail;
+
+    if(tail != captureHead)
+        lpm_edge();                            // torque line alive: keep capture
+
+    while(tail != captureHead)
+    {
+        srm_torque_pulse(captureFifo[tail & CAPTURE_FIFO_MASK]);
+        captureTail = ++tail;                  // slot free for the ISR again
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Page values: the last complete revolution, never a half updated one
+//------------------------------------------------------------------------------
+static void srm_publish(void)
+{
+    volatile srmSnap_t *s = SNAP_NEXT(srmSnap, srmSnapSeq);
+
+#ifdef ANT_CAD_CHANNEL
+    s->eventTime   = old_transmit_timer;
+#endif
+    s->timeStamp   = ctf_time_stamp1;
+    s->torqueTicks = ctf_torque_ticks1;
+    s->revolutions = srmRevolutions;
+    SNAP_PUBLISH(srmSnapSeq);
+}
+
+void srm_snapshot(srmSnap_t *snap)
+{
+    snap_read(snap, srmSnap, sizeof(*snap), &srmSnapSeq);
+}
+
+
+//------------------------------------------------------------------------------
+// One cadence marker: close the revolution gate and update the page values
+//------------------------------------------------------------------------------
+static void srm_revolution(void)
+{
+    uint32_t now;
+    uint32_t elapsed;
+    uint16_t period;
+    uint32_t ticks;
+
+    hal_led_cadence_toggle();                            // LED_ON
+
+    srmRevolutions++;
+
+    now = srm_time_extend(new_timer);
+    elapsed = now - old_transmit_timer;                  // any number of Timer1 wraps
+    if(elapsed > 0xFFFF)                                 // cranks stood still > 16 s:
+    {                                                    // 16 bit spans wrapped,
+        period = 0xFFFF;                                 // gated count only
+        ticks = srm_recip_ticks(recipCount, 0, 0);
+    }
+    else
+    {
+        period = (uint16_t)elapsed;
+        ticks = srm_recip_ticks(recipCount, calc_time_diff(recipLast,recipFirst), period);
+    }
+    torqueTicksAcc += ticks;
+    ctf_torque_ticks1 = (uint16_t)(torqueTicksAcc >> 8);  // accumulated, fraction carried
+    recipCount = 0;
+
+    srm_time_stamp_advance(elapsed);                     // accumulated, 1/2000 s
+
+    old_transmit_timer = now;
+    power_revolution(period, ticks);                     // page 0x10/0x12 values
+    srm_publish();                                       // page 0x20 values
+    log_revolution(ctf_time_stamp1, ctf_torque_ticks1);  // ride log in flash
+    srmDataSeq++;                                        // page goes out at the next slot
+}
+
+
+//------------------------------------------------------------------------------
+// Torque pulse on P2.2, capture = Timer1_A CCR1 latched at the edge
+//
+//  boot, srm_stall()
+//        |
+//        v
+//  SRM_WAIT_HEAD --edge--> SRM_TICKET --CADENCE_THRESHOLD_PULSE--> SRM_MARKER
+//                           ^    |                                       |
+//                           +----+------ gap > bundle: next head --------+
+//
+// SRM_WAIT_HEAD takes its first edge as a head without timing it against
+// the carrier: after boot there is no head before it, after a flash erase
+// stall the one before is too far back to tell anything.  An edge further than a quarter carrier period from the one before starts
+// a new bundle, unless it comes less than half a carrier period after the
+// last bundle head: then it is a glitch and dropped.  A marker bundle
+// counts one revolution however many pulses it has.
+//------------------------------------------------------------------------------
+void srm_torque_pulse(unsigned int capture)
+{
+    uint16_t bundle;
+    uint32_t sinceHead;                                  // 1/16 ticks, like srmCarrier
+    unsigned int timer_diff;
+
+    new_timer = capture;                                 // TIMER_A0->TIMER1_A0, TACCR0->TA1CCR1
+
+    timer_diff = calc_time_diff(new_timer,old_timer);
+    bundle = srmCarrier >> 6;                            // carrier / 4, whole ticks
+    if(bundle == 0)
+        bundle = 1;                                      // a bundle may straddle a tick
+
+    if(srmState != SRM_WAIT_HEAD && timer_diff <= bundle)
+    {
+        old_timer = new_timer;
+        if(PulseCount != 0xFFFF)
+            PulseCount++;
+        if(srmState == SRM_TICKET && PulseCount >= CADENCE_THRESHOLD_PULSE)
+        {
+            /*ׂpXCADENCE_THRESHOLD_PULSE{ȏ゠΁APCfX*/
+            srmState = SRM_MARKER;
+            srm_revolution();
+        }
+        return;
+    }
+
+    sinceHead = (uint32_t)calc_time_diff(new_timer,srmLastHead) << 4;
+    if(srmState != SRM_WAIT_HEAD && (sinceHead << 1) < srmCarrier
+       && ++srmGlitchRun < SRM_RELOCK_GLITCHES)
+    {
+        if(srmGlitches != 0xFFFF)
+            srmGlitches++;                               // under half a carrier period
+        return;
+    }
+
+    /*ׂpXō\ĂgN`Pbg̐擪JEg*/
+    if(sinceHead > 2 * (uint32_t)srmCarrier)             // carrier dropout: no more
+        sinceHead = 2 * (uint32_t)srmCarrier;            // than 2 periods' worth
+    if(sinceHead > SRM_CARRIER_MAX)
+        sinceHead = SRM_CARRIER_MAX;
+    if(srmGlitchRun >= SRM_RELOCK_GLITCHES)
+        srmCarrier = (uint16_t)sinceHead;                // carrier jumped, start over
+    else if(srmState != SRM_WAIT_HEAD)
+        srmCarrier += (int16_t)((uint16_t)sinceHead - srmCarrier) >> SRM_CARRIER_SHIFT;
+    srmGlitchRun = 0;
+    srmLastHead = new_timer;
+    old_timer = new_timer;
+    srmState = SRM_TICKET;
+
+    PulseCount = 1;                                      //Counter Clear
+
+    if(recipCount == 0)                                  // first head in this revolution
+        recipFirst = new_timer;
+    recipLast = new_timer;
+    if(recipCount != 0xFFFF)
+        recipCount++;
+}
+
+
+//------------------------------------------------------------------------------
+// The CPU was held for ticks by a flash erase (log.c).  The capture latch
+// kept the last edge of that time only, so the carrier heads in it are
+// added to the gate count from the carrier period; the reciprocal count
+// times the gate across the hole and would read it as less torque.  The
+// decoder then takes the latched edge as a fresh head, neither a glitch nor
+// a carrier period.
+//------------------------------------------------------------------------------
+void srm_stall(uint16_t ticks)
+{
+    uint16_t heads;
+
+    if(lpmEdges && recipCount != 0 && ticks < 0x1000 && srmCarrier != 0)
+    {
+        heads = (uint16_t)(ticks << 4) / srmCarrier;    // the latched edge
+        if(heads != 0)                                   // counts itself
+            heads--;
+        recipCount = heads > 0xFFFF - recipCount ? 0xFFFF : recipCount + heads;
+    }
+    srmState = SRM_WAIT_HEAD;
+}
+
+
+//------------------------------------------------------------------------------
+// Timer1_A period in OFFSETMODE, 4Hz each 250msec
+//------------------------------------------------------------------------------
+void srm_cal_tick(void)
+{
+    if(unqomode == OFFSETMODE)
+    {
+      cal_sample(recipCount, calc_time_diff(recipLast,recipFirst));
+      if(recipCount != 0)                                // last head opens the next gate
+          recipCount = 1;
+      recipFirst = recipLast;
+
+      if(calState == CAL_SETTLED)
+      {
+          hal_led_cadence_off();                          // LED_OFF, offset in flash
+      }
+      else if(chatter_count13 == 0)
+      {
+          chatter_count13 = 1;
+          hal_led_cadence_toggle();                        // LED_ON
+      }
+      else
+      {
+          chatter_count13 = 0;
+          hal_led_cadence_off();                            // LED_OFF
+      }
+
+      srmDataSeq++;                                      // page 0x01 goes out at the next slot
+
+//        /*for test*/
+//        srmRevolutions++;
+//
+//        ctf_torque_ticks1 = 1234;
+//        ctf_time_stamp1 = (uint16_t)(500 / 2);
+//
+//        sendPower_CTF1();
+
+    }
+}
+
+
+//------------------------------------------------------------------------------
+// Mode switch on P1.3: CTMMODE <-> OFFSETMODE
+//------------------------------------------------------------------------------
+void srm_mode_change(void)
+{
+    if(unqomode == OFFSETMODE)                           // P1.3 debounced in the main file
+    {
+        hal_led_mode_off();                              // LED_OFF
+        Timer1_A_period_init();
+        lpm_release(LPM_CAL);
+        unqomode = CTMMODE;
+    }
+    else
+    {
+        hal_led_mode_toggle();                           // LED_ON
+        Timer1_A_period_CAL_init();
+        lpm_claim(LPM_CAL | LPM_CAPTURE | LPM_SLOT);     // full rate, LPM3 at most
+        recipCount = 0;
+        cal_start();
+        unqomode = OFFSETMODE;
+    }
+    srmDataSeq++;                                        // other main page from now on
+}
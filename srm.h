@@ -0,0 +1,123 @@
+//******************************************************************************
+//  srm.h - SRM torque pulse decoder and calibration state
+//******************************************************************************
+#ifndef SRM_H
+#define SRM_H
+
+#include <stdint.h>
+#include "ant.h"                              // ANT_CAD_CHANNEL
+
+
+//#define kPeriod      0x2465 // 32768/37268*4=4Hz -> capture torque tickets
+//#define kPeriod      0x1FF6   //0x1FF6 8182/32768=4.004888780Hz
+//#define kPeriod      0xFFFF // 32768/37268*4=4Hz -> capture torque tickets
+#define kPeriod      0x04FD   //0x1FF6 8182/32768=4.004888780Hz
+
+enum{
+    CTMMODE = 1,
+    OFFSETMODE
+};
+
+//------------------------------------------------------------------------------
+// Torque line decoder.  The line carries torque tickets at the carrier
+// frequency (~500..2000 Hz), each a bundle of a few fine pulses, and once
+// per revolution a cadence marker: a bundle of CADENCE_THRESHOLD_PULSE or
+// more.  Fine pulses are ~10 us apart, well inside one Timer1 tick, so a
+// bundle shows as edges 0 or 1 tick apart.  The decoder tracks the carrier
+// period and derives from it how close edges must be to belong to one
+// bundle and how close a new bundle head may follow the last one before
+// it counts as a glitch.
+//------------------------------------------------------------------------------
+#define CADENCE_THRESHOLD_PULSE 13            // pulses in a bundle that make a marker
+#define SRM_CARRIER_SHIFT   3                 // carrier period EWMA over ~8 tickets
+#define SRM_CARRIER_INIT    (7 << 4)          // 1/16 ticks, ~600 Hz until measured
+#define SRM_CARRIER_MAX     (64 << 4)         // 64 Hz, anything slower is a dropout
+#define SRM_RELOCK_GLITCHES 4                 // this many in a row: carrier moved, follow it
+
+enum{
+    SRM_WAIT_HEAD = 0,                        // between bundles
+    SRM_TICKET,                               // in a bundle, not a marker (yet)
+    SRM_MARKER                                // in a marker bundle, revolution counted
+};
+
+//------------------------------------------------------------------------------
+// Capture FIFO: Timer1_A CCR1 time stamps of torque edges.  The capture ISR
+// is the only writer of captureHead, the main loop the only writer of
+// captureTail, so neither side needs to disable interrupts.
+//------------------------------------------------------------------------------
+#define CAPTURE_FIFO_SIZE   16                // must be a power of two
+#define CAPTURE_FIFO_MASK   (CAPTURE_FIFO_SIZE - 1)
+
+extern volatile uint16_t captureFifo[CAPTURE_FIFO_SIZE];
+extern volatile uint8_t captureHead;
+extern volatile uint8_t captureTail;
+extern uint16_t captureOverflow;              // edges dropped, FIFO was full
+extern uint16_t captureMissed;                // edges lost in hardware (COV)
+
+extern uint8_t  srmState;
+extern uint16_t srmCarrier;                   // carrier period, 1/16 Timer1 ticks
+extern uint16_t srmGlitches;                  // bundle heads rejected as too early
+
+extern unsigned int new_timer;
+extern unsigned int old_timer;
+extern uint32_t old_transmit_timer;
+extern unsigned int PulseCount;
+extern unsigned int chatter_count13;
+extern uint16_t ctf_time_stamp1;
+extern uint16_t ctf_torque_ticks1;
+extern uint16_t srmRevolutions;               // revolutions, 16 bit: cadence page
+                                              // count, its low byte the page 0x20
+                                              // event count
+extern uint16_t recipCount;
+extern uint16_t recipFirst;
+extern uint16_t recipLast;
+extern uint32_t torqueTicksAcc;
+
+//------------------------------------------------------------------------------
+// Revolution values the pages carry, published as one set (snap.h) at the
+// end of every revolution
+//------------------------------------------------------------------------------
+typedef struct {
+#ifdef ANT_CAD_CHANNEL
+    uint32_t eventTime;                       // old_transmit_timer, extended Timer1
+#endif
+    uint16_t timeStamp;                       // ctf_time_stamp1, 1/2000 s
+    uint16_t torqueTicks;                     // ctf_torque_ticks1
+    uint16_t revolutions;                     // srmRevolutions
+} srmSnap_t;
+
+extern uint8_t srmDataSeq;                    // bumped whenever the main page changes
+extern int unqomode;
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+int  calc_time_diff(int end_t,int start_t);
+void srm_torque_pulse(unsigned int capture);
+uint32_t srm_recip_ticks(uint16_t count, uint16_t span, uint16_t gate);
+void srm_capture_drain(void);
+void srm_stall(uint16_t ticks);               // CPU held, edges lost: flash erase
+
+void srm_snapshot(srmSnap_t *snap);
+
+void srm_cal_tick(void);
+void srm_mode_change(void);
+
+//------------------------------------------------------------------------------
+// Called from the capture ISR only
+//------------------------------------------------------------------------------
+static inline void capture_push(uint16_t stamp)
+{
+    uint8_t head = captureHead;
+
+    if((uint8_t)(head - captureTail) >= CAPTURE_FIFO_SIZE)
+    {
+        if(captureOverflow != 0xFFFF)
+            captureOverflow++;
+        return;
+    }
+    captureFifo[head & CAPTURE_FIFO_MASK] = stamp;
+    captureHead = head + 1;                   // publish after the stamp is in
+}
+
+#endif // SRM_H
@@ -0,0 +1,44 @@
+//******************************************************************************
+//  stack.c - stack painting and high-water mark
+//******************************************************************************
+
+#include "hal.h"
+#include "stack.h"
+
+uint16_t stackSize;
+uint16_t stackUsed;
+
+//------------------------------------------------------------------------------
+// Paint from the bottom of the region up to the stack pointer.  Everything
+// below the stack pointer is free while interrupts are off; the bytes this
+// function's own frame uses are above it.
+//------------------------------------------------------------------------------
+void stack_paint(void)
+{
+    uint8_t *p = hal_stack_low();
+    uint8_t *sp = hal_stack_pointer();
+
+    while(p < sp)
+        *p++ = STACK_PAINT;
+
+    stackSize = (uint16_t)(hal_stack_high() - hal_stack_low());
+}
+
+//------------------------------------------------------------------------------
+// Count untouched paint from the bottom up.  Data pushed at the deepest
+// point that happens to equal STACK_PAINT reads as paint, so the mark can
+// come out a byte or two short, never long.
+//------------------------------------------------------------------------------
+void stack_probe(void)
+{
+    const uint8_t *p = hal_stack_low();
+    const uint8_t *high = hal_stack_high();
+    uint16_t untouched;
+
+    while(p < high && *p == STACK_PAINT)
+        p++;
+    untouched = (uint16_t)(p - hal_stack_low());
+
+    if(stackSize - untouched > stackUsed)
+        stackUsed = stackSize - untouched;
+}
@@ -0,0 +1,31 @@
+//******************************************************************************
+//  stack.h - stack painting and high-water mark
+//
+//  main() fills the free part of the stack region with STACK_PAINT before
+//  interrupts are enabled.  Whatever the main loop and the vectors push
+//  later overwrites the paint, so the lowest overwritten byte is the
+//  deepest the stack has ever been.  stack_probe() finds it by scanning up
+//  from the bottom, in the main loop only; page 0xF2 in the common page
+//  rotation carries the result.
+//
+//  The region is the one the linker reserves for the stack (hal.h).  When
+//  the used part reaches its bottom, the stack has overflowed into static
+//  RAM and stackUsed reads stackSize.
+//******************************************************************************
+#ifndef STACK_H
+#define STACK_H
+
+#include <stdint.h>
+
+#define STACK_PAINT         0xA5              // not 0x00 or 0xFF, both common
+
+extern uint16_t stackSize;                    // bytes in the stack region
+extern uint16_t stackUsed;                    // most bytes ever in use
+
+//------------------------------------------------------------------------------
+// Function prototypes
+//------------------------------------------------------------------------------
+void stack_paint(void);                       // first thing in main(), GIE off
+void stack_probe(void);                       // update stackUsed
+
+#endif // STACK_H
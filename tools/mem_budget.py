@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+#******************************************************************************
+#  tools/mem_budget.py - static RAM and flash use per module and per symbol,
+#  checked against a budget
+#
+#  Reads the symbol tables of the object files with nm (GNU binutils, or
+#  msp430-elf-nm; both read the ELF objects CCS, IAR-ELF and msp430-gcc
+#  produce) and sorts every sized symbol into
+#      text    code                        flash
+#      rodata  constants, boot frames      flash
+#      data    initialised variables       RAM, plus their image in flash
+#      bss     zeroed variables            RAM
+#  then prints a table per module, the largest symbols, and the totals
+#  against the budget file.  Exits 1 when any budget is exceeded, so a
+#  build script or CI step can stop on it.
+#
+#  usage: mem_budget.py [-b budget.txt] [--nm NM] [--top N] obj...
+#         mem_budget.py [options] -c NAME obj... [-c NAME obj...]
+#         -b     budget file (tools/mem_budget.txt next to this script)
+#         -c     one build configuration and its objects; repeat it to check
+#                the default and the ISR_PROFILE build in one run, each
+#                against the whole budget
+#         --nm   nm to run (msp430-elf-nm if on PATH, else nm)
+#         --top  how many of the largest RAM and flash symbols to list (15)
+#
+#  RAM is checked as data + bss + the stack reserve from the budget file;
+#  the stack high-water mark on page 0xF2 (stack.h) tells whether the
+#  reserve itself is enough.
+#******************************************************************************
+
+import argparse
+import os
+import shutil
+import subprocess
+import sys
+
+KINDS = ("text", "rodata", "data", "bss")
+
+NM_KIND = {
+    "t": "text", "T": "text",
+    "r": "rodata", "R": "rodata",
+    "d": "data", "D": "data", "g": "data", "G": "data",
+    "b": "bss", "B": "bss", "s": "bss", "S": "bss", "C": "bss",
+}
+
+
+def load_budget(path):
+    budget = {}
+    with open(path) as f:
+        for line in f:
+            line = line.split("#", 1)[0].split()
+            if not line:
+                continue
+            if len(line) != 2:
+                sys.exit("%s: bad line: %s" % (path, " ".join(line)))
+            budget[line[0]] = int(line[1], 0)
+    return budget
+
+
+def symbols(nm, path):
+    out = subprocess.run([nm, "-S", "-t", "d", path], check=True,
+                         stdout=subprocess.PIPE, universal_newlines=True).stdout
+    for line in out.splitlines():
+        f = line.split()
+        if len(f) != 4 or f[2] not in NM_KIND:
+            continue                            # undefined, or no size
+        yield f[3], NM_KIND[f[2]], int(f[1])
+
+
+def module_name(path):
+    return os.path.splitext(os.path.basename(path))[0]
+
+
+def report(title, objs, budget, nm, top):
+    """Tables and budget check for one build configuration, list of failures"""
+    modules = {}
+    syms = []
+    for path in objs:
+        name = module_name(path)
+        use = modules.setdefault(name, dict.fromkeys(KINDS, 0))
+        for sym, kind, size in symbols(nm, path):
+            use[kind] += size
+            syms.append((size, kind, name, sym))
+
+    if title:
+        print("== %s\n" % title)
+    print("%-16s %7s %7s %7s %7s   %7s %7s" % (("module",) + KINDS + ("flash", "ram")))
+    total = dict.fromkeys(KINDS, 0)
+    for name in sorted(modules):
+        use = modules[name]
+        for k in KINDS:
+            total[k] += use[k]
+        print("%-16s %7d %7d %7d %7d   %7d %7d" % (
+            name, use["text"], use["rodata"], use["data"], use["bss"],
+            use["text"] + use["rodata"] + use["data"], use["data"] + use["bss"]))
+    flash = total["text"] + total["rodata"] + total["data"]
+    ram = total["data"] + total["bss"]
+    print("%-16s %7d %7d %7d %7d   %7d %7d" % (
+        "total", total["text"], total["rodata"], total["data"], total["bss"], flash, ram))
+
+    for what, kinds in (("RAM", ("data", "bss")), ("flash", ("text", "rodata", "data"))):
+        print("\nlargest %s symbols" % what)
+        for size, kind, name, sym in sorted((s for s in syms if s[1] in kinds), reverse=True)[:top]:
+            print("  %6d  %-6s %-12s %s" % (size, kind, name, sym))
+
+    failed = []
+    stack = budget.get("stack", 0)
+
+    def check(what, used, key):
+        if key in budget and used > budget[key]:
+            failed.append("%s%s %d > %d (%s)" % (
+                title + ": " if title else "", what, used, budget[key], key))
+
+    check("RAM incl. stack", ram + stack, "ram")
+    check("flash", flash, "flash")
+    for name, use in sorted(modules.items()):
+        check(name + " RAM", use["data"] + use["bss"], "ram." + name)
+        check(name + " flash", use["text"] + use["rodata"] + use["data"], "flash." + name)
+
+    print()
+    if "ram" in budget:
+        print("RAM    %5d + stack %d = %5d of %5d, %5d spare" % (
+            ram, stack, ram + stack, budget["ram"], budget["ram"] - ram - stack))
+    if "flash" in budget:
+        print("flash  %5d of %5d, %5d spare" % (flash, budget["flash"], budget["flash"] - flash))
+    print()
+    return failed
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    ap = argparse.ArgumentParser()
+    ap.add_argument("-b", dest="budget", default=os.path.join(here, "mem_budget.txt"))
+    ap.add_argument("-c", dest="configs", action="append", nargs="+", default=[],
+                    metavar=("NAME", "OBJ"))
+    ap.add_argument("--nm", default=shutil.which("msp430-elf-nm") or "nm")
+    ap.add_argument("--top", type=int, default=15)
+    ap.add_argument("objs", nargs="*")
+    args = ap.parse_args()
+
+    configs = [("", args.objs)] if args.objs else []
+    for c in args.configs:
+        if len(c) < 2:
+            ap.error("-c needs a name and at least one object")
+        configs.append((c[0], c[1:]))
+    if not configs:
+        ap.error("no object files")
+
+    budget = load_budget(args.budget)
+    failed = []
+    for title, objs in configs:
+        failed += report(title, objs, budget, args.nm, args.top)
+    for f in failed:
+        print("over budget: " + f)
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())